@@ -32,7 +32,7 @@ if ispc
         
     options = { ...
         ['-I' pwd]; ['-I' HACKRF_INC_DIR]; ...
-        ['-L' HACKRF_LIB_DIR]; '-lhackrf' ...
+        ['-L' HACKRF_LIB_DIR]; '-lhackrf'; '-lws2_32' ...
     };
 
 elseif isunix
@@ -42,6 +42,9 @@ elseif isunix
     options = { ...
         ['-I' HACKRF_INC_DIR]; ['-l' 'hackrf'] ...
     };
+    if ~ismac
+        options = [options; {'-lrt'}];  % shm_open with glibc < 2.17
+    end
 
 else
     error('Platform not supported');
@@ -56,6 +59,10 @@ options = [options; varargin'; { ...
     ['-DSIMULINK_HACKRF_VERSION=' VERSION]; ...
     '-outdir'; BIN_DIR; ...
 }];
+if ~ispc
+    % vectorize filter loops, keeping the rest of the gcc/clang defaults
+    options = [options; {'COPTIMFLAGS=-O3 -fwrapv -DNDEBUG'}];
+end
 
 %% Compile
 if isunix && ~any(ismember(varargin, '-v'))
@@ -65,16 +72,25 @@ end
 fprintf('\nBuilding target ''%s'':\n', 'hackrf_find_devices.c');
 mex(options{:}, 'src/hackrf_find_devices.c')
 
+device = {'src/device.c', 'src/remote.c', 'src/mock.c'};  % device backends
+
 fprintf('\nBuilding target ''%s'':\n', 'hackrf_source.c');
-mex(options{:}, 'src/hackrf_source.c', 'src/common.c')
+mex(options{:}, 'src/hackrf_source.c', 'src/common.c', ...
+    'src/dsp.c', 'src/channelizer.c', 'src/agc.c', device{:})
 
 fprintf('\nBuilding target ''%s'':\n', 'hackrf_sink.c');
-mex(options{:}, 'src/hackrf_sink.c', 'src/common.c')
+mex(options{:}, 'src/hackrf_sink.c', 'src/common.c', 'src/dsp.c', device{:})
+
+if isunix
+    fprintf('\nBuilding target ''%s'':\n', 'hackrf_shm_read.c');
+    mex(options{:}, 'src/hackrf_shm_read.c')
+end
 
 warning('on', 'MATLAB:mex:GccVersion_link');
 
 %% Post
 copyfile('src/hackrf_find_devices.m', BIN_DIR)
+if isunix; copyfile('src/hackrf_shm_read.m', BIN_DIR); end
 copyfile('blockset/hackrf_library.slx', BIN_DIR)
 copyfile('blockset/slblocks.m', BIN_DIR)
 
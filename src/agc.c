@@ -0,0 +1,192 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "agc.h"
+
+
+#define LNA_GAIN_MAX 40   /* step 8 dB */
+#define VGA_GAIN_MAX 62   /* step 2 dB */
+#define CLIP_BACKOFF 6.0  /* min. reduction (dB) if samples clipped */
+
+
+static void split_gain(double total, int *lna_gain, int *vga_gain)
+{
+    /* spread over both stages in proportion to their range */
+    if (total < 0) total = 0;
+    if (total > LNA_GAIN_MAX + VGA_GAIN_MAX) total = LNA_GAIN_MAX + VGA_GAIN_MAX;
+    int lna = 8 * (int) floor(total * LNA_GAIN_MAX / (LNA_GAIN_MAX + VGA_GAIN_MAX) / 8 + 0.5);
+    int vga = 2 * (int) floor((total - lna) / 2 + 0.5);
+    *lna_gain = lna;
+    *vga_gain = (vga < 0) ? 0 : (vga > VGA_GAIN_MAX) ? VGA_GAIN_MAX : vga;
+}
+
+
+static void *agc_thread(void *arg)
+{
+    Agc *agc = arg;
+    const double high = agc->target * pow(10.0, agc->hysteresis / 20),
+                 low = agc->target / pow(10.0, agc->hysteresis / 20);
+
+    pthread_mutex_lock(&agc->mutex);
+    while (!agc->quit) {
+        pthread_cond_wait(&agc->cond, &agc->mutex);
+        if (agc->quit || agc->pending || agc->settling || !agc->samples)
+            continue;
+        int peak = agc->peak;
+        unsigned long clipped = agc->clipped;
+        agc->peak = 0;
+        agc->clipped = agc->samples = 0;
+
+        /* hysteresis: act only outside [low, high] */
+        double change = 0.0;
+        if (clipped || peak > high) {
+            change = -20 * log10((peak > 0 ? peak : 1) / agc->target);
+            if (clipped && change > -CLIP_BACKOFF) change = -CLIP_BACKOFF;
+        } else if (peak < low)
+            change = 20 * log10(agc->target / (peak > 0 ? peak : 1));
+        if (change == 0.0) continue;
+
+        int lna, vga;
+        split_gain(agc->lna_gain + agc->vga_gain + change, &lna, &vga);
+        if (lna == agc->lna_gain && vga == agc->vga_gain) continue;
+        pthread_mutex_unlock(&agc->mutex);
+
+        /* control transfers block, keep the callback running meanwhile */
+        bool lna_set = lna != agc->lna_gain &&
+                device_set(agc->device, DEVICE_LNA_GAIN, lna) == HACKRF_SUCCESS;
+        bool vga_set = vga != agc->vga_gain &&
+                device_set(agc->device, DEVICE_VGA_GAIN, vga) == HACKRF_SUCCESS;
+
+        pthread_mutex_lock(&agc->mutex);
+        if (lna_set) agc->lna_gain = lna;
+        if (vga_set) agc->vga_gain = vga;
+        agc->pending = lna_set || vga_set;
+    }
+    pthread_mutex_unlock(&agc->mutex);
+    return NULL;
+}
+
+
+/* ========================================================================*/
+
+
+Agc* agc_new(double target, double hysteresis)
+{
+    Agc *agc = calloc(1, sizeof(Agc));
+    agc->target = 128.0 * target;
+    agc->hysteresis = hysteresis;
+    pthread_mutex_init(&agc->mutex, NULL);
+    pthread_cond_init(&agc->cond, NULL);
+    return agc;
+}
+
+
+void agc_start(Agc *agc, Device *device, int lna_gain, int vga_gain)
+{
+    agc->device = device;
+    agc->lna_gain = lna_gain;
+    agc->vga_gain = vga_gain;
+    agc->peak = 0;
+    agc->clipped = agc->samples = 0;
+    agc->sample_index = 0;
+    agc->settling = agc->pending = agc->quit = false;
+    agc->log_written = agc->log_read = 0;
+    agc->output_index = 0;
+    agc->current.lna_gain = lna_gain;
+    agc->current.vga_gain = vga_gain;
+    agc->current.sample_index = -1;
+    agc->running = pthread_create(&agc->thread, NULL, agc_thread, agc) == 0;
+}
+
+
+void agc_stop(Agc *agc)
+{
+    if (!agc->running) return;
+    pthread_mutex_lock(&agc->mutex);
+    agc->quit = true;
+    pthread_cond_signal(&agc->cond);
+    pthread_mutex_unlock(&agc->mutex);
+    pthread_join(agc->thread, NULL);
+    agc->running = false;
+}
+
+
+void agc_free(Agc *agc)
+{
+    agc_stop(agc);
+    pthread_mutex_destroy(&agc->mutex);
+    pthread_cond_destroy(&agc->cond);
+    free(agc);
+}
+
+
+/* ========================================================================*/
+
+
+void agc_process(Agc *agc, const unsigned char *buffer, int length, bool delivered)
+{
+    const signed char *iq = (const signed char*) buffer;
+    int peak = 0;
+    unsigned long clipped = 0;
+    int i = 0; for (; i < length; i++) {
+        int v = iq[i] < 0 ? -iq[i] : iq[i];
+        if (v > peak) peak = v;
+        clipped += (v >= 127);
+    }
+
+    pthread_mutex_lock(&agc->mutex);
+    if (agc->pending) {
+        /* first transfer received after the gain was set */
+        if (agc->log_written - agc->log_read == AGC_LOG_SIZE) agc->log_read++;
+        AgcChange *change = &agc->log[agc->log_written % AGC_LOG_SIZE];
+        change->lna_gain = agc->lna_gain;
+        change->vga_gain = agc->vga_gain;
+        change->sample_index = (double) agc->sample_index;
+        agc->log_written++;
+        agc->pending = false;
+        agc->settling = true;  /* transfers in flight may predate the change */
+    } else if (agc->settling) {
+        agc->settling = false;
+    } else {
+        if (peak > agc->peak) agc->peak = peak;
+        agc->clipped += clipped;
+        agc->samples += (unsigned long) length / 2;
+    }
+    if (delivered) agc->sample_index += (uint64_t) length / 2;
+    pthread_cond_signal(&agc->cond);
+    pthread_mutex_unlock(&agc->mutex);
+}
+
+
+bool agc_next_change(Agc *agc, double end, AgcChange *change)
+{
+    bool found = false;
+    pthread_mutex_lock(&agc->mutex);
+    while (agc->log_read < agc->log_written &&
+           agc->log[agc->log_read % AGC_LOG_SIZE].sample_index < end) {
+        *change = agc->log[agc->log_read % AGC_LOG_SIZE];
+        agc->log_read++;
+        found = true;
+    }
+    pthread_mutex_unlock(&agc->mutex);
+    return found;
+}
@@ -0,0 +1,87 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_AGC_H
+#define HACKRF_AGC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pthread.h"
+#include "device.h"
+
+
+/* ======================================================================== */
+
+
+#define AGC_LOG_SIZE 64
+
+typedef struct {
+    int lna_gain, vga_gain;       /* dB */
+    double sample_index;          /* first sample received with this gain */
+} AgcChange;
+
+
+/* Automatic gain control. The RX callback collects peak and clipping
+   statistics on the raw samples, a control thread adjusts LNA and VGA
+   gain. Each change is logged with the index of the first sample that
+   was received after it was set. */
+typedef struct {
+    double target;                /* peak magnitude, raw units */
+    double hysteresis;            /* dB around target without action */
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running, quit;
+    Device *device;
+
+    /* statistics since the last control step, written by the callback */
+    int peak;
+    unsigned long clipped, samples;
+    uint64_t sample_index;        /* samples delivered so far */
+    bool settling;                /* discard stats until a change applies */
+
+    /* gain state, owned by the control thread */
+    int lna_gain, vga_gain;
+    bool pending;                 /* set, but not yet stamped */
+
+    /* change log, written by the callback, read by mdlOutputs */
+    AgcChange log[AGC_LOG_SIZE];
+    uint64_t log_written, log_read;
+
+    /* consumer state */
+    double output_index;          /* samples output so far */
+    AgcChange current;            /* gain in effect at output_index */
+} Agc;
+
+
+/* target: peak magnitude relative to full scale, hysteresis in dB */
+Agc* agc_new(double target, double hysteresis);
+void agc_start(Agc *agc, Device *device, int lna_gain, int vga_gain);
+void agc_stop(Agc *agc);
+void agc_free(Agc *agc);
+
+/* RX callback: statistics of a transfer, delivered if it went to the ring */
+void agc_process(Agc *agc, const unsigned char *buffer, int length, bool delivered);
+
+/* consumer: update change to the latest one before sample index end */
+bool agc_next_change(Agc *agc, double end, AgcChange *change);
+
+#endif /* HACKRF_AGC_H */
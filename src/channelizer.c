@@ -0,0 +1,252 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "channelizer.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+static int num_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return (int) n;
+#endif
+    return 1;
+}
+
+
+/* ========================================================================*/
+
+
+static void process_range(Channelizer *ch, ChannelizerWorker *w, int n0, int n1)
+{
+    const int M = ch->num_channels, D = ch->decimation, T = ch->taps_per_channel;
+    float *acc_re = w->acc_re, *acc_im = w->acc_im;
+
+    int n = n0; for (; n < n1; n++) {
+        /* branch p: sum_t h[t M + p] x[n D - t M - p], evaluated for all
+           branches at once on contiguous (reversed) data */
+        const int base = ch->history + n * D - (M - 1);
+        memset(acc_re, 0, M * sizeof(float));
+        memset(acc_im, 0, M * sizeof(float));
+        int t = 0; for (; t < T; t++) {
+            const float *h = ch->taps + t * M,
+                        *xr = ch->in_re + base - t * M,
+                        *xi = ch->in_im + base - t * M;
+            int q = 0; for (; q < M; q++) {
+                acc_re[q] += h[q] * xr[q];
+                acc_im[q] += h[q] * xi[q];
+            }
+        }
+        int p = 0; for (; p < M; p++) {
+            w->fft_re[p] = acc_re[M - 1 - p];
+            w->fft_im[p] = acc_im[M - 1 - p];
+        }
+        fft_inverse(ch->fft, w->fft_re, w->fft_im);
+
+        /* undo the phase of the decimated mixer for oversampled banks */
+        unsigned n_mod = (ch->phase + (unsigned) n) % (unsigned) M;
+        int j = 0; for (; j < ch->num_outputs; j++) {
+            int k = ch->channels[j];
+            int m = (int) ((unsigned) (k * D % M) * n_mod % (unsigned) M);
+            float yr = w->fft_re[k], yi = w->fft_im[k],
+                  cr = ch->rot_re[m], ci = ch->rot_im[m];
+            ch->outputs[j][2 * n]     = yr * cr - yi * ci;
+            ch->outputs[j][2 * n + 1] = yr * ci + yi * cr;
+        }
+    }
+}
+
+
+static void process_slice(Channelizer *ch, ChannelizerWorker *w)
+{
+    int per_thread = (ch->outputs_per_frame + ch->num_threads - 1) / ch->num_threads;
+    int n0 = w->index * per_thread, n1 = n0 + per_thread;
+    if (n1 > ch->outputs_per_frame) n1 = ch->outputs_per_frame;
+    if (n0 < n1) process_range(ch, w, n0, n1);
+}
+
+
+static void *worker_main(void *arg)
+{
+    ChannelizerWorker *w = arg;
+    Channelizer *ch = w->ch;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&ch->mutex);
+    for (;;) {
+        while (!ch->quit && ch->generation == seen)
+            pthread_cond_wait(&ch->start, &ch->mutex);
+        if (ch->quit) break;
+        seen = ch->generation;
+        pthread_mutex_unlock(&ch->mutex);
+
+        process_slice(ch, w);
+
+        pthread_mutex_lock(&ch->mutex);
+        if (--ch->busy == 0) pthread_cond_signal(&ch->done);
+    }
+    pthread_mutex_unlock(&ch->mutex);
+    return NULL;
+}
+
+
+/* ========================================================================*/
+
+
+Channelizer* channelizer_new(int num_channels, int oversampling,
+                             const int *channels, int num_outputs,
+                             int frame_size, int num_threads)
+{
+    const int M = num_channels, T = CHANNELIZER_TAPS_PER_CHANNEL;
+    Channelizer *ch = calloc(1, sizeof(Channelizer));
+    ch->num_channels = M;
+    ch->decimation = M / oversampling;
+    ch->taps_per_channel = T;
+    ch->frame_size = frame_size;
+    ch->outputs_per_frame = frame_size / ch->decimation;
+    ch->num_outputs = num_outputs;
+    ch->channels = malloc(num_outputs * sizeof(int));
+    int i = 0; for (; i < num_outputs; i++)
+        ch->channels[i] = ((channels[i] % M) + M) % M;
+    ch->outputs = calloc(num_outputs, sizeof(double*));
+
+    /* prototype with channel bandwidth, stored reversed within each block
+       of M taps so that the branch filters run forward over the input */
+    float *proto = malloc(T * M * sizeof(float));
+    design_lowpass(proto, T * M, 0.5 / M);
+    ch->taps = malloc(T * M * sizeof(float));
+    int t = 0; for (; t < T; t++)
+        for (i = 0; i < M; i++)
+            ch->taps[t * M + i] = proto[t * M + M - 1 - i];
+    free(proto);
+
+    ch->history = T * M - 1;
+    ch->in_re = malloc((ch->history + frame_size) * sizeof(float));
+    ch->in_im = malloc((ch->history + frame_size) * sizeof(float));
+    ch->rot_re = malloc(M * sizeof(float));
+    ch->rot_im = malloc(M * sizeof(float));
+    for (i = 0; i < M; i++) {
+        ch->rot_re[i] = (float) cos(2.0 * M_PI * i / M);
+        ch->rot_im[i] = (float) -sin(2.0 * M_PI * i / M);
+    }
+    ch->fft = fft_plan_new(M);
+    channelizer_reset(ch);
+
+    if (num_threads <= 0) num_threads = num_cpus();
+    if (num_threads > CHANNELIZER_MAX_THREADS) num_threads = CHANNELIZER_MAX_THREADS;
+    if (num_threads > ch->outputs_per_frame) num_threads = ch->outputs_per_frame;
+    ch->workers = calloc(num_threads, sizeof(ChannelizerWorker));
+    pthread_mutex_init(&ch->mutex, NULL);
+    pthread_cond_init(&ch->start, NULL);
+    pthread_cond_init(&ch->done, NULL);
+    for (i = 0; i < num_threads; i++) {
+        ChannelizerWorker *w = &ch->workers[i];
+        w->ch = ch;
+        w->index = i;
+        w->acc_re = malloc(M * sizeof(float));
+        w->acc_im = malloc(M * sizeof(float));
+        w->fft_re = malloc(M * sizeof(float));
+        w->fft_im = malloc(M * sizeof(float));
+        /* worker 0 is the calling thread */
+        if (i > 0 && pthread_create(&w->thread, NULL, worker_main, w)) {
+            /* run with the workers started so far, none wait on the rest */
+            free(w->acc_re); free(w->acc_im);
+            free(w->fft_re); free(w->fft_im);
+            break;
+        }
+    }
+    ch->num_threads = i;
+    return ch;
+}
+
+
+void channelizer_reset(Channelizer *ch)
+{
+    memset(ch->in_re, 0, ch->history * sizeof(float));
+    memset(ch->in_im, 0, ch->history * sizeof(float));
+    ch->phase = 0;
+}
+
+
+void channelizer_process(Channelizer *ch, const signed char *in)
+{
+    float *re = ch->in_re + ch->history, *im = ch->in_im + ch->history;
+    int i = 0; for (; i < ch->frame_size; i++) {
+        re[i] = in[2 * i] / 128.0f;
+        im[i] = in[2 * i + 1] / 128.0f;
+    }
+
+    if (ch->num_threads > 1) {
+        pthread_mutex_lock(&ch->mutex);
+        ch->busy = ch->num_threads - 1;
+        ch->generation++;
+        pthread_cond_broadcast(&ch->start);
+        pthread_mutex_unlock(&ch->mutex);
+    }
+    process_slice(ch, &ch->workers[0]);
+    if (ch->num_threads > 1) {
+        pthread_mutex_lock(&ch->mutex);
+        while (ch->busy) pthread_cond_wait(&ch->done, &ch->mutex);
+        pthread_mutex_unlock(&ch->mutex);
+    }
+
+    /* keep the tail of this frame as history for the next one */
+    memmove(ch->in_re, ch->in_re + ch->frame_size, ch->history * sizeof(float));
+    memmove(ch->in_im, ch->in_im + ch->frame_size, ch->history * sizeof(float));
+    ch->phase = (ch->phase + ch->outputs_per_frame) % ch->num_channels;
+}
+
+
+void channelizer_free(Channelizer *ch)
+{
+    pthread_mutex_lock(&ch->mutex);
+    ch->quit = true;
+    pthread_cond_broadcast(&ch->start);
+    pthread_mutex_unlock(&ch->mutex);
+
+    int i = 0; for (; i < ch->num_threads; i++) {
+        ChannelizerWorker *w = &ch->workers[i];
+        if (i > 0) pthread_join(w->thread, NULL);
+        free(w->acc_re); free(w->acc_im);
+        free(w->fft_re); free(w->fft_im);
+    }
+    free(ch->workers);
+    pthread_mutex_destroy(&ch->mutex);
+    pthread_cond_destroy(&ch->start);
+    pthread_cond_destroy(&ch->done);
+
+    fft_plan_free(ch->fft);
+    free(ch->channels);
+    free(ch->outputs);
+    free(ch->taps);
+    free(ch->in_re); free(ch->in_im);
+    free(ch->rot_re); free(ch->rot_im);
+    free(ch);
+}
@@ -0,0 +1,81 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_CHANNELIZER_H
+#define HACKRF_CHANNELIZER_H
+
+#include <stdbool.h>
+
+#include "pthread.h"
+#include "dsp.h"
+
+
+/* ======================================================================== */
+
+
+#define CHANNELIZER_TAPS_PER_CHANNEL  8
+#define CHANNELIZER_MAX_THREADS      16
+
+struct Channelizer;
+
+typedef struct {
+    struct Channelizer *ch;
+    pthread_t thread;
+    int index;
+    float *acc_re, *acc_im;       /* polyphase branch outputs, reversed */
+    float *fft_re, *fft_im;
+} ChannelizerWorker;
+
+
+/* Polyphase filter bank analysis channelizer. Channel k is centered at
+   k / num_channels times the sample rate and decimated by num_channels /
+   oversampling. Output frames are split across worker threads. */
+typedef struct Channelizer {
+    int num_channels, decimation, taps_per_channel;
+    int frame_size, outputs_per_frame;
+    int num_outputs, *channels;   /* selected channels, one per output */
+    double **outputs;             /* interleaved complex, set by the caller */
+
+    float *taps;                  /* prototype, reversed per branch block */
+    float *in_re, *in_im;         /* filter history followed by frame */
+    int history;
+    unsigned phase;               /* output index modulo num_channels */
+    float *rot_re, *rot_im;       /* exp(-j 2 pi m / num_channels) */
+    FFTPlan *fft;
+
+    ChannelizerWorker *workers;
+    int num_threads;              /* including the calling thread */
+    pthread_mutex_t mutex;
+    pthread_cond_t start, done;
+    unsigned generation;
+    int busy;
+    bool quit;
+} Channelizer;
+
+
+/* num_threads == 0 selects the number of online processors */
+Channelizer* channelizer_new(int num_channels, int oversampling,
+                             const int *channels, int num_outputs,
+                             int frame_size, int num_threads);
+void channelizer_reset(Channelizer *ch);
+/* in: frame_size interleaved int8 IQ samples, results go to ch->outputs */
+void channelizer_process(Channelizer *ch, const signed char *in);
+void channelizer_free(Channelizer *ch);
+
+#endif /* HACKRF_CHANNELIZER_H */
@@ -18,12 +18,19 @@
 */
 
 
+#include <errno.h>
+#include <string.h>
+#ifndef _WIN32
+#include <signal.h>  /* kill */
+#endif
+
 #include "common.h"
 
 
 SampleBuffer* sample_buffer_new()
 {
     SampleBuffer *sbuf = malloc(sizeof(SampleBuffer));
+    sbuf->shm = NULL;
     sample_buffer_reset(sbuf);
     int i = 0; for (; i < NUMBER_OF_BUFFERS; i++)
         sbuf->buffers[i] = malloc(BUFFER_SIZE);
@@ -32,20 +39,113 @@ SampleBuffer* sample_buffer_new()
     return sbuf;
 }
 
+#ifndef _WIN32
+static bool shm_is_stale(const char *name)
+{
+    /* left behind by a source whose process is gone */
+    const HackrfShm *shm = hackrf_shm_attach(name);
+    if (!shm) return false;
+    pid_t pid = (pid_t) shm->writer_pid;
+    hackrf_shm_detach(shm);
+    return pid > 0 && kill(pid, 0) && errno == ESRCH;
+}
+
+static unsigned long shm_inode(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    struct stat st;
+    unsigned long inode = fstat(fd, &st) ? 0 : (unsigned long) st.st_ino;
+    close(fd);
+    return inode;
+}
+#endif
+
+
+SampleBuffer* sample_buffer_new_shared(const char *name, double sample_rate)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return NULL;
+#else
+    if (strlen(name) >= HACKRF_SHM_NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        /* replace a segment of a crashed run, never one still published */
+        if (!shm_is_stale(name)) {
+            errno = EBUSY;
+            return NULL;
+        }
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) return NULL;
+    struct stat st;
+    size_t size = hackrf_shm_size(BUFFER_SIZE, NUMBER_OF_BUFFERS);
+    void *map = MAP_FAILED;
+    if (!fstat(fd, &st) && !ftruncate(fd, (off_t) size))
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name);
+        errno = error;
+        return NULL;
+    }
+
+    HackrfShm *shm = map;  /* zero filled by ftruncate */
+    shm->version = HACKRF_SHM_VERSION;
+    shm->buffer_size = BUFFER_SIZE;
+    shm->num_buffers = NUMBER_OF_BUFFERS;
+    shm->data_offset = HACKRF_SHM_DATA_OFFSET;
+    shm->sample_rate = sample_rate;
+    shm->writer_pid = getpid();
+    __atomic_store_n(&shm->magic, HACKRF_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    SampleBuffer *sbuf = malloc(sizeof(SampleBuffer));
+    sbuf->shm = shm;
+    strcpy(sbuf->shm_name, name);
+    sbuf->shm_inode = (unsigned long) st.st_ino;
+    sample_buffer_reset(sbuf);
+    int i = 0; for (; i < NUMBER_OF_BUFFERS; i++)
+        sbuf->buffers[i] = hackrf_shm_slot(shm, i);
+    pthread_mutex_init(&sbuf->mutex, NULL);
+    pthread_cond_init(&sbuf->cond_var, NULL);
+    return sbuf;
+#endif
+}
+
 void sample_buffer_reset(SampleBuffer* sbuf)
 {
-    sbuf->head = sbuf->tail = sbuf->ready = 0;
+    /* a shared ring continues at the slot of the next published buffer */
+    sbuf->head = sbuf->tail = sbuf->shm ?
+        (int) (sbuf->shm->generation % NUMBER_OF_BUFFERS) : 0;
+    sbuf->ready = 0;
     sbuf->offset = 0;
     sbuf->startup_skip = 2;
     sbuf->error = SB_NO_ERROR;
     sbuf->had_error = false;
+    sbuf->idle = false;
 }
 
 
 void sample_buffer_free(SampleBuffer* sbuf)
 {
-    int i = 0; for (; i < NUMBER_OF_BUFFERS; ++i)
-        if (sbuf->buffers[i]) free(sbuf->buffers[i]);
+#ifndef _WIN32
+    if (sbuf->shm) {
+        /* attached readers keep their mapping until they detach */
+        munmap(sbuf->shm, hackrf_shm_size(BUFFER_SIZE, NUMBER_OF_BUFFERS));
+        if (shm_inode(sbuf->shm_name) == sbuf->shm_inode)
+            shm_unlink(sbuf->shm_name);
+    } else
+#endif
+    {
+        int i = 0; for (; i < NUMBER_OF_BUFFERS; ++i)
+            if (sbuf->buffers[i]) free(sbuf->buffers[i]);
+    }
     pthread_mutex_destroy(&sbuf->mutex);
     pthread_cond_destroy(&sbuf->cond_var);
     free(sbuf);
@@ -55,27 +155,31 @@ void sample_buffer_free(SampleBuffer* sbuf)
 /* ========================================================================*/
 
 
-hackrf_device *startHackrf(SimStruct *S,
-                           double sample_rate, double bandwidth,
-                           bool print_info)
+void get_opt_string(SimStruct *S, int index, char *value, size_t size)
+{
+    value[0] = '\0';
+    if (ssGetSFcnParamsCount(S) > index && mxIsChar(ssGetSFcnParam(S, index)))
+        mxGetString(ssGetSFcnParam(S, index), value, (mwSize) size);
+}
+
+
+Device *startHackrf(SimStruct *S, const char *address,
+                    double sample_rate, double bandwidth,
+                    bool print_info)
 {
-    hackrf_device *device;
-    int ret = hackrf_open(&device);
+    Device *device;
+    int ret = device_open(address, &device);
     Hackrf_assert(S, ret, "Failed to open HackRF device", device);
 
     /* show device info */
     if (print_info) {
-        enum hackrf_board_id board_id = BOARD_ID_INVALID;
-        ret = hackrf_board_id_read(device, (uint8_t *) &board_id);
-        Hackrf_assert(S, ret, "Failed to get HackRF board id", device);
-        char version[255 + 1];
-        ret = hackrf_version_string_read(device, &version[0], 255);
-        Hackrf_assert(S, ret, "Failed to read version string", device);
-        ssPrintf("Using %s with firmware %s\n",
-                 hackrf_board_id_name(board_id), version);
+        char info[256 + 64];
+        ret = device_info(device, info, sizeof(info));
+        Hackrf_assert(S, ret, "Failed to read HackRF board id and version", device);
+        ssPrintf("Using %s\n", info);
     }
     /* set sample rate */
-    ret = hackrf_set_sample_rate(device, sample_rate);
+    ret = device_set(device, DEVICE_SAMPLE_RATE, sample_rate);
     Hackrf_assert(S, ret, "Failed to set sample rate", device);
     if (print_info)
         if (sample_rate >= 1e6)
@@ -88,7 +192,7 @@ hackrf_device *startHackrf(SimStruct *S,
     /* set filter bandwidth (0 means automatic filter selection) */
     if (bandwidth == 0.0) bandwidth = sample_rate * 0.75;
     uint32_t bw = hackrf_compute_baseband_filter_bw((uint32_t) bandwidth);
-    ret = hackrf_set_baseband_filter_bandwidth(device, bw);
+    ret = device_set(device, DEVICE_BANDWIDTH, bw);
     Hackrf_assert(S, ret, "Failed to set filter bandwidth", device);
 
     return device;
@@ -97,10 +201,12 @@ hackrf_device *startHackrf(SimStruct *S,
 
 void stopHackRf(SimStruct *S, int device_index)
 {
-    hackrf_device *device = ssGetPWorkValue(S, device_index);
+    Device *device = ssGetPWorkValue(S, device_index);
     if (!device) return;
-    if (hackrf_is_streaming(device))
-        Hackrf_assert(S, hackrf_stop_rx(device), "Failed to stop RX streaming");
-    Hackrf_assert(S, hackrf_close(device), "Failed to close HackRF");
+    if (device_is_streaming(device))
+        Hackrf_assert(S, device_stop(device), "Failed to stop streaming");
+    if (device_lost(device))
+        ssPrintf("%lu transfers lost on the network\n", device_lost(device));
+    Hackrf_assert(S, device_close(device), "Failed to close HackRF");
     ssSetPWorkValue(S, device_index, NULL);
 }
\ No newline at end of file
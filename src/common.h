@@ -28,6 +28,8 @@
 
 #include "pthread.h"
 #include "hackrf.h"
+#include "device.h"
+#include "hackrf_shm.h"
 
 
 /* ======================================================================== */
@@ -56,6 +58,11 @@ typedef struct {
 
     enum SampleBufferError error;
     bool had_error;
+    volatile bool idle;                         /* no burst in progress (TX) */
+
+    HackrfShm *shm;                             /* shared segment of the buffers */
+    char shm_name[HACKRF_SHM_NAME_MAX];
+    unsigned long shm_inode;                    /* to unlink only our own segment */
 
     pthread_mutex_t mutex;
     pthread_cond_t cond_var;
@@ -63,6 +70,9 @@ typedef struct {
 
 
 SampleBuffer* sample_buffer_new();
+/* buffers in a POSIX shared-memory segment, NULL and errno set on failure
+   (EBUSY if the name is used by a running source) */
+SampleBuffer* sample_buffer_new_shared(const char *name, double sample_rate);
 void sample_buffer_reset(SampleBuffer* sbuf);
 void sample_buffer_free(SampleBuffer* sbuf);
 
@@ -71,6 +81,9 @@ void sample_buffer_free(SampleBuffer* sbuf);
 
 
 #define GetParam(index) mxGetScalar(ssGetSFcnParam(S, index))
+/* trailing parameters may be omitted, e.g. by the masks of older models */
+#define GetOptParam(index, default_value) \
+    ((ssGetSFcnParamsCount(S) > (index)) ? GetParam(index) : (default_value))
 
 static char error_msg[512];
 #define ssSetErrorStatusf(S, msg, ...) do { \
@@ -84,6 +97,24 @@ static char error_msg[512];
         return; \
     }
 
+#define Assert_opt_is_numeric(S, param) \
+    if (ssGetSFcnParamsCount(S) > param) { \
+        Assert_is_numeric(S, param) \
+    }
+
+#define Assert_opt_is_string(S, param) \
+    if (ssGetSFcnParamsCount(S) > param && !mxIsChar(ssGetSFcnParam(S, param))) { \
+        ssSetErrorStatusf(S, "Parameter '%s' must be a string", #param); \
+        return; \
+    }
+
+#define Assert_num_params(S, min, max) \
+    if (ssGetSFcnParamsCount(S) < (min) || ssGetSFcnParamsCount(S) > (max)) { \
+        ssSetErrorStatusf(S, "Expected %d to %d parameters, got %d", \
+                          min, max, ssGetSFcnParamsCount(S)); \
+        return; \
+    }
+
 
 /* ======================================================================== */
 
@@ -94,11 +125,11 @@ static char error_msg[512];
         return __VA_ARGS__; \
     }
 
-#define Hackrf_set_param(S, action, cast, index, msg) do { \
+#define Hackrf_set_param(S, param, index, msg) do { \
     double value = GetParam(index), value_last = ssGetRWorkValue(S, index); \
     if (value != value_last) { \
         ssSetRWorkValue(S, index, value); \
-        int ret = action((hackrf_device*) ssGetPWorkValue(S, DEVICE), (cast) value); \
+        int ret = device_set((Device*) ssGetPWorkValue(S, DEVICE), param, value); \
         if (isnan(value_last)) Hackrf_assert(S, ret, msg); \
         if (ret != HACKRF_SUCCESS) { \
             snprintf(error_msg, sizeof(error_msg), "%s: %s (%d)", msg, hackrf_error_name(ret), ret); \
@@ -108,9 +139,13 @@ static char error_msg[512];
 } while(0);
 
 
-hackrf_device *startHackrf(SimStruct *S,
-                           double sample_rate, double bandwidth,
-                           bool print_info);
+/* trailing string parameter, empty if omitted */
+void get_opt_string(SimStruct *S, int index, char *value, size_t size);
+
+/* address: see device_open */
+Device *startHackrf(SimStruct *S, const char *address,
+                    double sample_rate, double bandwidth,
+                    bool print_info);
 void stopHackRf(SimStruct *S, int device_index);
 
 #endif /* HACKRF_COMMON_H */
\ No newline at end of file
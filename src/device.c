@@ -0,0 +1,151 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device.h"
+#include "remote.h"
+#include "mock.h"
+
+
+/* ======================================================================== */
+
+
+int device_open(const char *address, Device **device)
+{
+    Device *dev = calloc(1, sizeof(Device));
+    int ret;
+    if (!address || !address[0])
+        ret = hackrf_open(&dev->hackrf);
+    else if (!strcmp(address, "mock"))
+        ret = mock_open(&dev->mock);
+    else
+        ret = remote_open(address, &dev->remote);
+    if (ret != HACKRF_SUCCESS) {
+        free(dev);
+        dev = NULL;
+    }
+    *device = dev;
+    return ret;
+}
+
+
+int device_close(Device *device)
+{
+    int ret = device->remote ? remote_close(device->remote) :
+              device->mock ? mock_close(device->mock) :
+              hackrf_close(device->hackrf);
+    free(device);
+    return ret;
+}
+
+
+int device_info(Device *device, char *info, size_t size)
+{
+    if (device->remote) {
+        snprintf(info, size, "%s", remote_info(device->remote));
+        return HACKRF_SUCCESS;
+    }
+    if (device->mock) {
+        snprintf(info, size, "%s", mock_info(device->mock));
+        return HACKRF_SUCCESS;
+    }
+
+    enum hackrf_board_id board_id = BOARD_ID_INVALID;
+    int ret = hackrf_board_id_read(device->hackrf, (uint8_t *) &board_id);
+    if (ret != HACKRF_SUCCESS) return ret;
+    char version[255 + 1];
+    ret = hackrf_version_string_read(device->hackrf, &version[0], 255);
+    if (ret != HACKRF_SUCCESS) return ret;
+    snprintf(info, size, "%s with firmware %s",
+             hackrf_board_id_name(board_id), version);
+    return HACKRF_SUCCESS;
+}
+
+
+/* ======================================================================== */
+
+
+int device_set(Device *device, enum DeviceParam param, double value)
+{
+    if (device->remote) return remote_set(device->remote, param, value);
+    if (device->mock) return mock_set(device->mock, param, value);
+
+    hackrf_device *hackrf = device->hackrf;
+    switch (param) {
+        case DEVICE_SAMPLE_RATE: return hackrf_set_sample_rate(hackrf, value);
+        case DEVICE_BANDWIDTH:
+            return hackrf_set_baseband_filter_bandwidth(hackrf, (uint32_t) value);
+        case DEVICE_FREQ:        return hackrf_set_freq(hackrf, (uint64_t) value);
+        case DEVICE_AMP_ENABLE:  return hackrf_set_amp_enable(hackrf, (uint8_t) value);
+        case DEVICE_LNA_GAIN:    return hackrf_set_lna_gain(hackrf, (uint32_t) value);
+        case DEVICE_VGA_GAIN:    return hackrf_set_vga_gain(hackrf, (uint32_t) value);
+        case DEVICE_TXVGA_GAIN:  return hackrf_set_txvga_gain(hackrf, (uint32_t) value);
+        default:                 return HACKRF_ERROR_INVALID_PARAM;
+    }
+}
+
+
+/* ======================================================================== */
+
+
+static int device_start(Device *device, bool tx,
+                        hackrf_sample_block_cb_fn callback, void *ctx)
+{
+    device->tx = tx;
+    if (device->remote) return remote_start(device->remote, tx, callback, ctx);
+    if (device->mock) return mock_start(device->mock, tx, callback, ctx);
+    return tx ? hackrf_start_tx(device->hackrf, callback, ctx) :
+                hackrf_start_rx(device->hackrf, callback, ctx);
+}
+
+int device_start_rx(Device *device, hackrf_sample_block_cb_fn callback, void *ctx)
+{
+    return device_start(device, false, callback, ctx);
+}
+
+int device_start_tx(Device *device, hackrf_sample_block_cb_fn callback, void *ctx)
+{
+    return device_start(device, true, callback, ctx);
+}
+
+
+int device_stop(Device *device)
+{
+    if (device->remote) return remote_stop(device->remote);
+    if (device->mock) return mock_stop(device->mock);
+    return device->tx ? hackrf_stop_tx(device->hackrf) :
+                        hackrf_stop_rx(device->hackrf);
+}
+
+
+int device_is_streaming(Device *device)
+{
+    if (device->remote) return remote_is_streaming(device->remote);
+    if (device->mock) return mock_is_streaming(device->mock);
+    return hackrf_is_streaming(device->hackrf);
+}
+
+
+unsigned long device_lost(Device *device)
+{
+    return device->remote ? remote_lost(device->remote) : 0;
+}
@@ -0,0 +1,72 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_DEVICE_H
+#define HACKRF_DEVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hackrf.h"
+
+
+/* ======================================================================== */
+
+
+#define DEVICE_TRANSFER_SIZE  (16 * 32 * 512)  /* bytes, as libhackrf */
+
+enum DeviceParam {
+    DEVICE_SAMPLE_RATE = 0, DEVICE_BANDWIDTH, DEVICE_FREQ, DEVICE_AMP_ENABLE,
+    DEVICE_LNA_GAIN, DEVICE_VGA_GAIN, DEVICE_TXVGA_GAIN,
+    NUM_DEVICE_PARAMS
+};
+
+typedef struct RemoteDevice RemoteDevice;
+typedef struct MockDevice MockDevice;
+
+/* A HackRF on the local USB bus, one served by hackrf_tcp_server on
+   another host or a synthetic device for tests without hardware. Exactly
+   one backend is set. The functions mirror libhackrf, including its
+   callbacks and return codes. */
+typedef struct {
+    hackrf_device *hackrf;
+    RemoteDevice *remote;
+    MockDevice *mock;
+    bool tx;                        /* streaming direction */
+} Device;
+
+
+/* address: "" for the first local device, "mock" or "host[:port][,4bit]" */
+int device_open(const char *address, Device **device);
+int device_close(Device *device);
+/* board, firmware and location for display */
+int device_info(Device *device, char *info, size_t size);
+
+int device_set(Device *device, enum DeviceParam param, double value);
+
+int device_start_rx(Device *device, hackrf_sample_block_cb_fn callback, void *ctx);
+int device_start_tx(Device *device, hackrf_sample_block_cb_fn callback, void *ctx);
+int device_stop(Device *device);
+int device_is_streaming(Device *device);
+
+/* transfers lost between device and host, e.g. on the network */
+unsigned long device_lost(Device *device);
+
+#endif /* HACKRF_DEVICE_H */
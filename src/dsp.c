@@ -0,0 +1,219 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+void design_lowpass(float *taps, int length, double cutoff)
+{
+    double sum = 0.0, center = (length - 1) / 2.0;
+    int i = 0; for (; i < length; i++) {
+        double x = i - center, h = 2.0 * cutoff;
+        if (x != 0.0) h = sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        /* Blackman window */
+        double w = 2.0 * M_PI * i / (length - 1);
+        h *= 0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+        taps[i] = (float) h;
+        sum += h;
+    }
+    for (i = 0; i < length; i++) taps[i] = (float) (taps[i] / sum);
+}
+
+
+bool is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+
+/* ========================================================================*/
+
+
+FFTPlan* fft_plan_new(int size)
+{
+    FFTPlan *plan = malloc(sizeof(FFTPlan));
+    plan->size = size;
+    plan->bitrev = malloc(size * sizeof(int));
+    plan->cos = malloc((size / 2 + 1) * sizeof(float));
+    plan->sin = malloc((size / 2 + 1) * sizeof(float));
+
+    int bits = 0; while ((1 << bits) < size) bits++;
+    int i = 0; for (; i < size; i++) {
+        int r = 0, b = 0;
+        for (; b < bits; b++) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        plan->bitrev[i] = r;
+    }
+    for (i = 0; i <= size / 2; i++) {
+        plan->cos[i] = (float) cos(2.0 * M_PI * i / size);
+        plan->sin[i] = (float) sin(2.0 * M_PI * i / size);
+    }
+    return plan;
+}
+
+
+void fft_plan_free(FFTPlan *plan)
+{
+    free(plan->bitrev);
+    free(plan->cos);
+    free(plan->sin);
+    free(plan);
+}
+
+
+void fft_inverse(const FFTPlan *plan, float *re, float *im)
+{
+    int n = plan->size, i = 0;
+    for (; i < n; i++) {
+        int j = plan->bitrev[i];
+        if (j > i) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    int len = 2; for (; len <= n; len <<= 1) {
+        int half = len / 2, step = n / len;
+        int start = 0; for (; start < n; start += len) {
+            int k = 0; for (; k < half; k++) {
+                float wr = plan->cos[k * step], wi = plan->sin[k * step];
+                int a = start + k, b = a + half;
+                float tr = re[b] * wr - im[b] * wi,
+                      ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr; im[b] = im[a] - ti;
+                re[a] += tr; im[a] += ti;
+            }
+        }
+    }
+}
+
+
+/* ========================================================================*/
+
+
+Interpolator* interpolator_new(int factor, int taps_per_phase, int max_block)
+{
+    const int L = factor, T = taps_per_phase;
+    Interpolator *interp = malloc(sizeof(Interpolator));
+    interp->factor = L;
+    interp->taps_per_phase = T;
+    interp->max_block = max_block;
+
+    float *proto = malloc(T * L * sizeof(float));
+    design_lowpass(proto, T * L, 0.5 / L);
+    interp->taps = malloc(T * L * sizeof(float));
+    int p = 0; for (; p < L; p++) {
+        int u = 0; for (; u < T; u++)
+            interp->taps[p * T + u] = L * proto[(T - 1 - u) * L + p];
+    }
+    free(proto);
+
+    interp->in_re = malloc((T - 1 + max_block) * sizeof(float));
+    interp->in_im = malloc((T - 1 + max_block) * sizeof(float));
+    interp->acc_re = malloc(L * max_block * sizeof(float));
+    interp->acc_im = malloc(L * max_block * sizeof(float));
+    interpolator_reset(interp);
+    return interp;
+}
+
+
+void interpolator_reset(Interpolator *interp)
+{
+    memset(interp->in_re, 0, (interp->taps_per_phase - 1) * sizeof(float));
+    memset(interp->in_im, 0, (interp->taps_per_phase - 1) * sizeof(float));
+}
+
+
+void interpolator_process(Interpolator *interp, const signed char *in, int count,
+                          float *out_re, float *out_im)
+{
+    const int L = interp->factor, T = interp->taps_per_phase, H = T - 1;
+    float *x_re = interp->in_re, *x_im = interp->in_im;
+    int n = 0; for (; n < count; n++) {
+        x_re[H + n] = in[2 * n];
+        x_im[H + n] = in[2 * n + 1];
+    }
+
+    /* y[n L + p] = sum_u g_p[u] x[n - H + u] */
+    int p = 0; for (; p < L; p++) {
+        float *acc_re = interp->acc_re + p * count,
+              *acc_im = interp->acc_im + p * count;
+        memset(acc_re, 0, count * sizeof(float));
+        memset(acc_im, 0, count * sizeof(float));
+        int u = 0; for (; u < T; u++) {
+            const float g = interp->taps[p * T + u],
+                        *xr = x_re + u, *xi = x_im + u;
+            for (n = 0; n < count; n++) {
+                acc_re[n] += g * xr[n];
+                acc_im[n] += g * xi[n];
+            }
+        }
+    }
+    for (p = 0; p < L; p++)
+        for (n = 0; n < count; n++) {
+            out_re[n * L + p] = interp->acc_re[p * count + n];
+            out_im[n * L + p] = interp->acc_im[p * count + n];
+        }
+
+    memmove(x_re, x_re + count, H * sizeof(float));
+    memmove(x_im, x_im + count, H * sizeof(float));
+}
+
+
+void interpolator_free(Interpolator *interp)
+{
+    free(interp->taps);
+    free(interp->in_re); free(interp->in_im);
+    free(interp->acc_re); free(interp->acc_im);
+    free(interp);
+}
+
+
+/* ========================================================================*/
+
+
+void nco_reset(NCO *nco)
+{
+    nco->phase = 0.0;
+}
+
+
+void nco_mix(NCO *nco, float *re, float *im, int count)
+{
+    if (nco->frequency == 0.0) return;
+    /* phasor recursion in double, re-anchored to the exact phase per call */
+    double pr = cos(2.0 * M_PI * nco->phase), pi = sin(2.0 * M_PI * nco->phase),
+           sr = cos(2.0 * M_PI * nco->frequency), si = sin(2.0 * M_PI * nco->frequency);
+    int n = 0; for (; n < count; n++) {
+        float r = re[n], i = im[n];
+        re[n] = (float) (r * pr - i * pi);
+        im[n] = (float) (r * pi + i * pr);
+        double t = pr * sr - pi * si;
+        pi = pr * si + pi * sr;
+        pr = t;
+    }
+    nco->phase += count * nco->frequency;
+    nco->phase -= floor(nco->phase);
+}
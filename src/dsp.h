@@ -0,0 +1,86 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_DSP_H
+#define HACKRF_DSP_H
+
+#include <stdbool.h>
+
+
+/* ======================================================================== */
+
+
+/* windowed-sinc lowpass, cutoff in cycles per sample, unity gain at DC */
+void design_lowpass(float *taps, int length, double cutoff);
+
+bool is_power_of_two(int value);
+
+
+/* ======================================================================== */
+
+
+typedef struct {
+    int size;                 /* power of two */
+    int *bitrev;              /* bit reversed indices */
+    float *cos, *sin;         /* twiddle factors, size / 2 */
+} FFTPlan;
+
+
+FFTPlan* fft_plan_new(int size);
+void fft_plan_free(FFTPlan *plan);
+
+/* in-place unnormalized inverse DFT (positive exponent) on split data */
+void fft_inverse(const FFTPlan *plan, float *re, float *im);
+
+/* ======================================================================== */
+
+
+/* Polyphase FIR interpolator for int8 IQ input. The per-phase filters are
+   evaluated for a whole block at once so the inner loops run over
+   contiguous data and vectorize. */
+typedef struct {
+    int factor, taps_per_phase, max_block;
+    float *taps;              /* per phase, reversed, scaled by factor */
+    float *in_re, *in_im;     /* filter history followed by block */
+    float *acc_re, *acc_im;   /* per phase outputs, factor * max_block */
+} Interpolator;
+
+
+Interpolator* interpolator_new(int factor, int taps_per_phase, int max_block);
+void interpolator_reset(Interpolator *interp);
+/* count <= max_block input samples to count * factor outputs (split data) */
+void interpolator_process(Interpolator *interp, const signed char *in, int count,
+                          float *out_re, float *out_im);
+void interpolator_free(Interpolator *interp);
+
+
+/* ======================================================================== */
+
+
+typedef struct {
+    double phase;             /* cycles, [0, 1) */
+    double frequency;         /* cycles per sample */
+} NCO;
+
+
+void nco_reset(NCO *nco);
+/* multiply by exp(j 2 pi phase), then advance the phase */
+void nco_mix(NCO *nco, float *re, float *im, int count);
+
+#endif /* HACKRF_DSP_H */
@@ -17,6 +17,16 @@
 * Boston, MA 02110-1301, USA.
 */
 
+#include <math.h>  /* NAN */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "mex.h"
 #include "hackrf.h"
 
@@ -26,41 +36,329 @@
 #define Hackrf_assert(ret, msg) if (ret != HACKRF_SUCCESS) \
     mexErrMsgIdAndTxt("hackrf:finddevices", "%s (error %d)", msg, ret);
 
+/* close the device first, otherwise it stays claimed until MATLAB exits */
+#define Hackrf_assert_close(device, ret, msg) if (ret != HACKRF_SUCCESS) { \
+    hackrf_close(device); hackrf_exit(); \
+    mexErrMsgIdAndTxt("hackrf:finddevices", "%s (error %d)", msg, ret); \
+}
 
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs,
-        const mxArray *prhs[]) 
-{
-    mexPrintf("Simulink-HackRF version %s\n\n", STR(SIMULINK_HACKRF_VERSION));
 
-    /* init hackrf and open device */
-    Hackrf_assert(hackrf_init(), "Failed to init HackRF API");
-    
-    hackrf_device *device;
-    int ret = hackrf_open(&device);
-    Hackrf_assert(ret, (ret == HACKRF_ERROR_NOT_FOUND) ?
-                       "No HackRF device found" : "Failed to open HackRF");
+/* ======================================================================== */
+
 
+static const char *device_fields[] = {
+    "index", "board", "firmware", "part_id", "serial"
+};
+#define NUM_DEVICE_FIELDS (sizeof(device_fields) / sizeof(device_fields[0]))
+
+/* prints the failed read and returns its error, so listing can go on */
+#define Check_read(ret, msg) if (ret != HACKRF_SUCCESS) { \
+    mexPrintf("%s (error %d)\n", msg, ret); \
+    return ret; \
+}
+
+static int print_device_info(hackrf_device *device, mxArray *info, int index)
+{
     /* read hackrf board id and version */
     enum hackrf_board_id board_id = BOARD_ID_INVALID;
-    ret = hackrf_board_id_read(device, (uint8_t*) &board_id);
-    Hackrf_assert(ret, "Failed to get HackRF board id");
+    int ret = hackrf_board_id_read(device, (uint8_t*) &board_id);
+    Check_read(ret, "Failed to get HackRF board id");
     char version[255 + 1];
     ret = hackrf_version_string_read(device, &version[0], 255);
-    Hackrf_assert(ret, "Failed to read version string");
+    Check_read(ret, "Failed to read version string");
     mexPrintf("Found %s device with firmware %s\n",
               hackrf_board_id_name(board_id), version);
 
     /* read part id and serial number */
     read_partid_serialno_t data;
     ret = hackrf_board_partid_serialno_read(device, &data);
-    Hackrf_assert(ret, "Failed to read part ID number and serial number");
-    mexPrintf("  Part ID Number: 0x%08x 0x%08x\n",
-              data.part_id[0], data.part_id[1]);
-    mexPrintf("  Serial Number: 0x%08x 0x%08x 0x%08x 0x%08x\n",
-              data.serial_no[0], data.serial_no[1],
-              data.serial_no[2], data.serial_no[3]);
-
-    /* close hackrf device and exit */
+    Check_read(ret, "Failed to read part ID number and serial number");
+    char part_id[2 * 11 + 1], serial[4 * 8 + 1];
+    snprintf(part_id, sizeof(part_id), "0x%08x 0x%08x",
+             data.part_id[0], data.part_id[1]);
+    snprintf(serial, sizeof(serial), "%08x%08x%08x%08x",
+             data.serial_no[0], data.serial_no[1],
+             data.serial_no[2], data.serial_no[3]);
+    mexPrintf("  Part ID Number: %s\n", part_id);
+    mexPrintf("  Serial Number: %s\n", serial);
+
+    if (!info) return HACKRF_SUCCESS;
+    mxSetField(info, index, "index", mxCreateDoubleScalar(index));
+    mxSetField(info, index, "board", mxCreateString(hackrf_board_id_name(board_id)));
+    mxSetField(info, index, "firmware", mxCreateString(version));
+    mxSetField(info, index, "part_id", mxCreateString(part_id));
+    mxSetField(info, index, "serial", mxCreateString(serial));
+    return HACKRF_SUCCESS;
+}
+
+
+/* ======================================================================== */
+
+
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double) count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void sleep_seconds(double seconds)
+{
+#ifdef _WIN32
+    Sleep((DWORD) (seconds * 1e3));
+#else
+    usleep((useconds_t) (seconds * 1e6));
+#endif
+}
+
+
+typedef struct {
+    unsigned char *scratch;       /* stands in for the blocks' sample buffer */
+    size_t scratch_size;
+    int transfer_size;
+
+    volatile unsigned long transfers;
+    double t_first, t_prev;
+    double interval_sum, interval_max;
+    double callback_sum, callback_max;
+} BenchStats;
+
+
+static void bench_record(BenchStats *stats, hackrf_transfer *transfer, double t_start)
+{
+    double t_end = now(), duration = t_end - t_start;
+    if (stats->transfers) {
+        double interval = t_start - stats->t_prev;
+        stats->interval_sum += interval;
+        if (interval > stats->interval_max) stats->interval_max = interval;
+    } else {
+        stats->t_first = t_start;
+        stats->transfer_size = transfer->valid_length;
+    }
+    stats->t_prev = t_start;
+    stats->callback_sum += duration;
+    if (duration > stats->callback_max) stats->callback_max = duration;
+    stats->transfers++;
+}
+
+static int bench_rx_callback(hackrf_transfer *transfer)
+{
+    double t_start = now();
+    BenchStats *stats = transfer->rx_ctx;
+    size_t len = (size_t) transfer->valid_length;
+    memcpy(stats->scratch, transfer->buffer,
+           len < stats->scratch_size ? len : stats->scratch_size);
+    bench_record(stats, transfer, t_start);
+    return 0;
+}
+
+static int bench_tx_callback(hackrf_transfer *transfer)
+{
+    double t_start = now();
+    BenchStats *stats = transfer->tx_ctx;
+    size_t len = (size_t) transfer->valid_length;
+    if (len > stats->scratch_size) {
+        memset(transfer->buffer + stats->scratch_size, 0, len - stats->scratch_size);
+        len = stats->scratch_size;
+    }
+    memcpy(transfer->buffer, stats->scratch, len);  /* silence */
+    bench_record(stats, transfer, t_start);
+    return 0;
+}
+
+
+static const char *bench_fields[] = {
+    "sample_rate", "duration", "transfers", "throughput", "dropped",
+    "interval_mean", "interval_max", "callback_mean", "callback_max"
+};
+#define NUM_BENCH_FIELDS (sizeof(bench_fields) / sizeof(bench_fields[0]))
+
+static mxArray *run_benchmark(hackrf_device *device, bool tx, double sample_rate,
+                              double frequency, double duration)
+{
+    BenchStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.scratch_size = 256 * 1024;
+    stats.scratch = mxCalloc(stats.scratch_size, 1);
+
+    int ret = hackrf_set_sample_rate(device, sample_rate);
+    Hackrf_assert_close(device, ret, "Failed to set sample rate");
+    uint32_t bw = hackrf_compute_baseband_filter_bw((uint32_t) (0.75 * sample_rate));
+    ret = hackrf_set_baseband_filter_bandwidth(device, bw);
+    Hackrf_assert_close(device, ret, "Failed to set filter bandwidth");
+    /* tune explicitly, otherwise TX leaks the LO at whatever was set last */
+    ret = hackrf_set_freq(device, (uint64_t) frequency);
+    Hackrf_assert_close(device, ret, "Failed to set frequency");
+
+    if (tx) {
+        /* transmit silence at minimum gain */
+        Hackrf_assert_close(device, hackrf_set_amp_enable(device, 0),
+                            "Failed to disable external amp");
+        Hackrf_assert_close(device, hackrf_set_txvga_gain(device, 0),
+                            "Failed to set TXVGA gain");
+        ret = hackrf_start_tx(device, bench_tx_callback, &stats);
+    } else
+        ret = hackrf_start_rx(device, bench_rx_callback, &stats);
+    Hackrf_assert_close(device, ret, "Failed to start streaming");
+
+    double t_start = now();
+    while (now() - t_start < duration &&
+           hackrf_is_streaming(device) == HACKRF_TRUE)
+        sleep_seconds(0.05);
+    bool stalled = hackrf_is_streaming(device) != HACKRF_TRUE;
+
+    ret = tx ? hackrf_stop_tx(device) : hackrf_stop_rx(device);
+    Hackrf_assert_close(device, ret, "Failed to stop streaming");
+    if (stalled)
+        mexWarnMsgIdAndTxt("hackrf:finddevices", "Device stopped streaming");
+
+    /* throughput and drops are measured between the first and the last
+       callback, so startup latency does not count against the host */
+    unsigned long transfers = stats.transfers;
+    double window = (transfers > 1) ? stats.t_prev - stats.t_first : 0.0;
+    double throughput = 0.0, dropped = 0.0;
+    if (window > 0.0) {
+        double samples_per_transfer = stats.transfer_size / 2.0;
+        throughput = (transfers - 1) * samples_per_transfer / window;
+        double expected = window * sample_rate / samples_per_transfer;
+        dropped = floor(expected + 0.5) - (transfers - 1);
+        if (dropped < 0.0) dropped = 0.0;
+    }
+
+    mexPrintf("  %s %.3f MSps: %lu transfers, %.3f MSps achieved, %.0f dropped\n",
+              tx ? "TX" : "RX", sample_rate / 1e6, transfers, throughput / 1e6, dropped);
+    mexPrintf("    callback interval mean %.3f ms max %.3f ms, "
+              "callback time mean %.3f ms max %.3f ms\n",
+              transfers > 1 ? 1e3 * stats.interval_sum / (transfers - 1) : 0.0,
+              1e3 * stats.interval_max,
+              transfers ? 1e3 * stats.callback_sum / transfers : 0.0,
+              1e3 * stats.callback_max);
+
+    mxArray *result = mxCreateStructMatrix(1, 1, NUM_BENCH_FIELDS, bench_fields);
+    mxSetField(result, 0, "sample_rate", mxCreateDoubleScalar(sample_rate));
+    mxSetField(result, 0, "duration", mxCreateDoubleScalar(window));
+    mxSetField(result, 0, "transfers", mxCreateDoubleScalar(transfers));
+    mxSetField(result, 0, "throughput", mxCreateDoubleScalar(throughput));
+    mxSetField(result, 0, "dropped", mxCreateDoubleScalar(dropped));
+    mxSetField(result, 0, "interval_mean", mxCreateDoubleScalar(
+        transfers > 1 ? stats.interval_sum / (transfers - 1) : NAN));
+    mxSetField(result, 0, "interval_max", mxCreateDoubleScalar(stats.interval_max));
+    mxSetField(result, 0, "callback_mean", mxCreateDoubleScalar(
+        transfers ? stats.callback_sum / transfers : NAN));
+    mxSetField(result, 0, "callback_max", mxCreateDoubleScalar(stats.callback_max));
+
+    mxFree(stats.scratch);
+    return result;
+}
+
+
+/* ======================================================================== */
+
+
+static double scalar_arg(int nrhs, const mxArray *prhs[], int index,
+                         double default_value)
+{
+    if (nrhs <= index || mxIsEmpty(prhs[index])) return default_value;
+    if (!mxIsNumeric(prhs[index]))
+        mexErrMsgIdAndTxt("hackrf:finddevices", "Argument %d must be numeric", index + 1);
+    return mxGetScalar(prhs[index]);
+}
+
+static void list_devices(int nlhs, mxArray *plhs[])
+{
+    hackrf_device_list_t *list = hackrf_device_list();
+    if (!list || list->devicecount == 0) {
+        if (list) hackrf_device_list_free(list);
+        hackrf_exit();
+        mexErrMsgIdAndTxt("hackrf:finddevices", "No HackRF device found");
+    }
+
+    mxArray *info = (nlhs > 0) ? mxCreateStructMatrix(
+        1, list->devicecount, NUM_DEVICE_FIELDS, device_fields) : NULL;
+
+    int i = 0; for (; i < list->devicecount; i++) {
+        hackrf_device *device;
+        mexPrintf("[%d] ", i);
+        int ret = hackrf_device_list_open(list, i, &device);
+        if (ret != HACKRF_SUCCESS) {
+            /* e.g. claimed by another process, keep enumerating */
+            mexPrintf("Failed to open HackRF device (error %d)\n", ret);
+            continue;
+        }
+        /* a device failing to answer is reported, the others still listed */
+        print_device_info(device, info, i);
+        ret = hackrf_close(device);
+        if (ret != HACKRF_SUCCESS) {
+            hackrf_device_list_free(list);
+            Hackrf_assert(ret, "Failed to close HackRF device");
+        }
+    }
+    hackrf_device_list_free(list);
+    if (info) plhs[0] = info;
+}
+
+static void benchmark(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    double duration = scalar_arg(nrhs, prhs, 1, 5.0),
+           rx_rate = scalar_arg(nrhs, prhs, 2, 20e6),
+           tx_rate = scalar_arg(nrhs, prhs, 3, 0.0);
+    int index = (int) scalar_arg(nrhs, prhs, 4, 0.0);
+    double frequency = scalar_arg(nrhs, prhs, 5, 2.45e9);
+    if (duration <= 0.0 || rx_rate < 0.0 || tx_rate < 0.0 || frequency <= 0.0)
+        mexErrMsgIdAndTxt("hackrf:finddevices", "Invalid benchmark arguments");
+
+    hackrf_device_list_t *list = hackrf_device_list();
+    if (!list || index < 0 || index >= list->devicecount) {
+        if (list) hackrf_device_list_free(list);
+        hackrf_exit();
+        mexErrMsgIdAndTxt("hackrf:finddevices", "No HackRF device with index %d", index);
+    }
+    hackrf_device *device;
+    int ret = hackrf_device_list_open(list, index, &device);
+    hackrf_device_list_free(list);
+    Hackrf_assert(ret, "Failed to open HackRF device");
+
+    mxArray *info = mxCreateStructMatrix(1, 1, NUM_DEVICE_FIELDS, device_fields);
+    mexPrintf("[%d] ", index);
+    Hackrf_assert_close(device, print_device_info(device, info, 0),
+                        "Failed to read device info");
+    mexPrintf("Benchmarking for %.1f s\n", duration);
+
+    static const char *fields[] = {"device", "rx", "tx"};
+    mxArray *result = mxCreateStructMatrix(1, 1, 3, fields);
+    mxSetField(result, 0, "device", info);
+    if (rx_rate > 0.0)
+        mxSetField(result, 0, "rx", run_benchmark(device, false, rx_rate, frequency, duration));
+    if (tx_rate > 0.0)  /* half-duplex, so TX runs after RX */
+        mxSetField(result, 0, "tx", run_benchmark(device, true, tx_rate, frequency, duration));
+
     Hackrf_assert(hackrf_close(device), "Failed to close HackRF device");
+    if (nlhs > 0) plhs[0] = result;
+    else mxDestroyArray(result);
+}
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[])
+{
+    mexPrintf("Simulink-HackRF version %s\n\n", STR(SIMULINK_HACKRF_VERSION));
+
+    char mode[16] = "";
+    if (nrhs > 0 && (!mxIsChar(prhs[0]) || mxGetString(prhs[0], mode, sizeof(mode)) ||
+                     strcmp(mode, "benchmark")))
+        mexErrMsgIdAndTxt("hackrf:finddevices", "Unknown mode, expected 'benchmark'");
+
+    Hackrf_assert(hackrf_init(), "Failed to init HackRF API");
+    if (nrhs > 0)
+        benchmark(nlhs, plhs, nrhs, prhs);
+    else
+        list_devices(nlhs, plhs);
     Hackrf_assert(hackrf_exit(), "Failed to exit HackRF API");
 }
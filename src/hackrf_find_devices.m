@@ -4,4 +4,26 @@ function hackrf_find_devices
 %   - device type
 %   - firmware version
 %   - part ID number
-%   - serial number
\ No newline at end of file
+%   - serial number
+%
+% DEVICES = HACKRF_FIND_DEVICES also returns a struct array with the fields
+% index, board, firmware, part_id and serial, one element per device.
+%
+% RESULT = HACKRF_FIND_DEVICES('benchmark', DURATION, RX_RATE, TX_RATE, INDEX, FREQ)
+% streams from (and optionally to) the device with the given INDEX for
+% DURATION seconds at the given sample rates to check whether the USB path
+% of the host sustains them. Defaults are 5 s, 20 MSps RX, no TX and the
+% first device. A rate of 0 skips that direction. TX runs after RX, as the
+% device is half-duplex, and sends silence at minimum gain. Both directions
+% are tuned to FREQ (Hz), 2.45 GHz by default; TX still leaks some carrier
+% there, so choose a frequency you may transmit on.
+%
+% RESULT has the fields device, rx and tx. rx and tx hold
+%
+%   - sample_rate     requested sample rate (Sps)
+%   - duration        time between first and last callback (s)
+%   - transfers       number of USB transfers seen
+%   - throughput      achieved sample rate (Sps)
+%   - dropped         transfers missing compared to the requested rate
+%   - interval_mean, interval_max   time between callbacks (s)
+%   - callback_mean, callback_max   time spent in the callback (s)
@@ -0,0 +1,210 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+/* Layout and access protocol of the shared-memory RX ring published by
+   hackrf_source. This header has no dependencies on MATLAB or libhackrf,
+   external readers only need to include it (and link -lrt on older
+   Linux systems).
+
+   The segment starts with a HackrfShm header, the buffers follow at
+   data_offset. Buffers hold interleaved signed 8 bit I and Q samples.
+   The source is the only writer and never waits for readers: buffer
+   number n (counting from segment creation) goes to slot n % num_buffers.
+   While a slot is written its seq is odd, afterwards it is 2 * (n + 1).
+   Then generation is set to n + 1.
+
+   Each reader keeps its own cursor, the next buffer number to read:
+
+       HackrfShmReader reader;
+       hackrf_shm_reader_init(&reader, shm);
+       for (;;) {
+           const signed char *iq = hackrf_shm_reader_acquire(&reader);
+           if (!iq) { wait a bit; continue; }
+           ... process buffer in place ...
+           if (!hackrf_shm_reader_validate(&reader))
+               ... overwritten while processing, discard results ...
+           hackrf_shm_reader_advance(&reader);
+       }
+
+   A reader that falls more than num_buffers behind is moved forward
+   to the oldest buffer still available, the skipped buffers are
+   counted in dropped. */
+
+#ifndef HACKRF_SHM_H
+#define HACKRF_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/* ======================================================================== */
+
+
+#define HACKRF_SHM_MAGIC        0x53465248  /* "HRFS" */
+#define HACKRF_SHM_VERSION      1
+#define HACKRF_SHM_MAX_BUFFERS  64
+#define HACKRF_SHM_DATA_OFFSET  4096        /* buffers start page aligned */
+#define HACKRF_SHM_NAME_MAX     64
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t buffer_size;           /* bytes per buffer */
+    uint32_t num_buffers;
+    uint64_t data_offset;           /* bytes from segment start to slot 0 */
+    double sample_rate;             /* Sps */
+
+    volatile uint64_t generation;   /* buffers published so far */
+    volatile uint64_t seq[HACKRF_SHM_MAX_BUFFERS];  /* per slot, see above */
+    int64_t writer_pid;             /* source process, to detect stale segments */
+} HackrfShm;
+
+typedef struct {
+    const HackrfShm *shm;
+    uint64_t cursor;                /* next buffer number to read */
+    uint64_t dropped;               /* buffers skipped or overwritten */
+    uint64_t seq;                   /* seq of slot seen on acquire */
+} HackrfShmReader;
+
+
+static inline size_t hackrf_shm_size(uint32_t buffer_size, uint32_t num_buffers)
+{
+    return HACKRF_SHM_DATA_OFFSET + (size_t) buffer_size * num_buffers;
+}
+
+static inline unsigned char *hackrf_shm_slot(const HackrfShm *shm, uint64_t slot)
+{
+    return (unsigned char*) shm + shm->data_offset + slot * shm->buffer_size;
+}
+
+
+/* access uses gcc/clang atomics, shared memory is POSIX only anyway */
+#ifndef _WIN32
+
+
+/* ======================================================================== */
+/* writer, slot must be generation % num_buffers */
+
+
+static inline void hackrf_shm_write_begin(HackrfShm *shm, int slot)
+{
+    __atomic_store_n(&shm->seq[slot], 2 * shm->generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  /* seq before data */
+}
+
+static inline void hackrf_shm_write_end(HackrfShm *shm, int slot)
+{
+    uint64_t generation = shm->generation + 1;
+    __atomic_store_n(&shm->seq[slot], 2 * generation, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->generation, generation, __ATOMIC_RELEASE);
+}
+
+
+/* ======================================================================== */
+/* readers */
+
+
+static inline void hackrf_shm_reader_init(HackrfShmReader *reader, const HackrfShm *shm)
+{
+    /* start with the next buffer published */
+    reader->shm = shm;
+    reader->cursor = __atomic_load_n(&shm->generation, __ATOMIC_ACQUIRE);
+    reader->dropped = 0;
+    reader->seq = 0;
+}
+
+/* buffer at the cursor, NULL if it is not published yet */
+static inline const signed char *hackrf_shm_reader_acquire(HackrfShmReader *reader)
+{
+    const HackrfShm *shm = reader->shm;
+    for (;;) {
+        uint64_t generation = __atomic_load_n(&shm->generation, __ATOMIC_ACQUIRE);
+        if (reader->cursor >= generation) return NULL;
+        if (generation - reader->cursor > shm->num_buffers) {
+            /* lapped: skip to the oldest buffer that may still be intact */
+            reader->dropped += generation - shm->num_buffers - reader->cursor;
+            reader->cursor = generation - shm->num_buffers;
+        }
+        uint64_t slot = reader->cursor % shm->num_buffers;
+        reader->seq = __atomic_load_n(&shm->seq[slot], __ATOMIC_ACQUIRE);
+        if (reader->seq == 2 * (reader->cursor + 1))
+            return (const signed char*) hackrf_shm_slot(shm, slot);
+        reader->dropped++;  /* being overwritten */
+        reader->cursor++;
+    }
+}
+
+/* true if the acquired buffer was not overwritten since acquire */
+static inline bool hackrf_shm_reader_validate(HackrfShmReader *reader)
+{
+    const HackrfShm *shm = reader->shm;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);  /* data before seq */
+    uint64_t slot = reader->cursor % shm->num_buffers;
+    return __atomic_load_n(&shm->seq[slot], __ATOMIC_RELAXED) == reader->seq;
+}
+
+static inline void hackrf_shm_reader_advance(HackrfShmReader *reader)
+{
+    reader->cursor++;
+}
+
+
+/* ======================================================================== */
+/* attach to a segment, NULL and errno set on failure */
+
+
+static inline const HackrfShm *hackrf_shm_attach(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    const HackrfShm *shm = MAP_FAILED;
+    if (fstat(fd, &st)) ;
+    else if ((size_t) st.st_size < sizeof(HackrfShm)) errno = EPROTO;
+    else shm = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (shm == MAP_FAILED) {
+        errno = error;
+        return NULL;
+    }
+    if (shm->magic != HACKRF_SHM_MAGIC || shm->version != HACKRF_SHM_VERSION ||
+        !shm->num_buffers || shm->num_buffers > HACKRF_SHM_MAX_BUFFERS ||
+        (size_t) st.st_size < hackrf_shm_size(shm->buffer_size, shm->num_buffers)) {
+        munmap((void*) shm, (size_t) st.st_size);
+        errno = EPROTO;
+        return NULL;
+    }
+    return shm;
+}
+
+static inline void hackrf_shm_detach(const HackrfShm *shm)
+{
+    munmap((void*) shm, hackrf_shm_size(shm->buffer_size, shm->num_buffers));
+}
+#endif /* _WIN32 */
+
+#endif /* HACKRF_SHM_H */
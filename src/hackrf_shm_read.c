@@ -0,0 +1,155 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mex.h"
+#include "hackrf_shm.h"
+
+#define Shm_error(...) mexErrMsgIdAndTxt("hackrf:shmread", __VA_ARGS__)
+
+
+/* ======================================================================== */
+
+
+#ifdef _WIN32
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[])
+{
+    Shm_error("Shared memory streams are not supported on Windows");
+}
+#else
+
+
+/* the reader stays attached between calls, so consecutive calls
+   return consecutive samples */
+static const HackrfShm *shm = NULL;
+static char shm_name[HACKRF_SHM_NAME_MAX];
+static HackrfShmReader reader;
+static uint64_t offset_cursor;      /* buffer the offset refers to */
+static size_t offset;               /* samples consumed of that buffer */
+
+static void detach(void)
+{
+    if (!shm) return;
+    hackrf_shm_detach(shm);
+    shm = NULL;
+}
+
+static void attach(const char *name)
+{
+    detach();
+    shm = hackrf_shm_attach(name);
+    if (!shm)
+        Shm_error("Failed to attach to shared memory %s: %s", name, strerror(errno));
+    strcpy(shm_name, name);
+    hackrf_shm_reader_init(&reader, shm);
+    offset_cursor = reader.cursor;
+    offset = 0;
+    mexAtExit(detach);
+}
+
+
+static const char *info_fields[] = {
+    "sample_rate", "sample_index", "dropped"
+};
+#define NUM_INFO_FIELDS (sizeof(info_fields) / sizeof(info_fields[0]))
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[])
+{
+    if (nrhs == 0) {
+        detach();
+        return;
+    }
+
+    char param[HACKRF_SHM_NAME_MAX - 1], name[HACKRF_SHM_NAME_MAX];
+    if (!mxIsChar(prhs[0]) || mxGetString(prhs[0], param, sizeof(param)))
+        Shm_error("Name must be a string (max. %d chars)", (int) sizeof(param) - 1);
+    snprintf(name, sizeof(name), "%s%s", (param[0] == '/') ? "" : "/", param);
+    if (nrhs < 2 || !mxIsNumeric(prhs[1]) || mxGetScalar(prhs[1]) < 0)
+        Shm_error("Number of samples must be a non-negative number");
+    size_t num_samples = (size_t) mxGetScalar(prhs[1]);
+    double timeout = (nrhs > 2) ? mxGetScalar(prhs[2]) : 1.0;
+
+    if (!shm || strcmp(name, shm_name)) attach(name);
+
+    mxArray *samples = mxCreateDoubleMatrix(num_samples, 1, mxCOMPLEX);
+    double *re = mxGetPr(samples), *im = mxGetPi(samples);
+    size_t samples_per_buffer = shm->buffer_size / 2, count = 0;
+    double sample_rate = shm->sample_rate;
+    uint64_t dropped = reader.dropped;
+    double sample_index = -1, waited = 0.0;
+
+    while (count < num_samples) {
+        const signed char *iq = hackrf_shm_reader_acquire(&reader);
+        if (!iq) {
+            if (waited >= timeout) break;
+            usleep(1000);
+            waited += 1e-3;
+            continue;
+        }
+        waited = 0.0;
+        if (reader.cursor != offset_cursor) {
+            /* skipped ahead, buffer not started yet */
+            offset_cursor = reader.cursor;
+            offset = 0;
+        }
+
+        size_t n = samples_per_buffer - offset, i = 0;
+        if (n > num_samples - count) n = num_samples - count;
+        iq += 2 * offset;
+        for (; i < n; i++) {
+            re[count + i] = iq[2 * i] / 128.0;
+            im[count + i] = iq[2 * i + 1] / 128.0;
+        }
+        if (!hackrf_shm_reader_validate(&reader))
+            continue;  /* overwritten while copying, acquire skips it */
+
+        if (sample_index < 0)
+            sample_index = (double) reader.cursor * samples_per_buffer + offset;
+        count += n;
+        offset += n;
+        if (offset == samples_per_buffer) {
+            hackrf_shm_reader_advance(&reader);
+            offset_cursor = reader.cursor;
+            offset = 0;
+        }
+    }
+
+    if (count < num_samples) {
+        /* the source may have been restarted, attach again next time */
+        mexWarnMsgIdAndTxt("hackrf:shmread", "No samples from %s for %.1f s",
+                           shm_name, timeout);
+        detach();
+        mxSetM(samples, count);
+    }
+    plhs[0] = samples;
+
+    if (nlhs > 1) {
+        mxArray *info = mxCreateStructMatrix(1, 1, NUM_INFO_FIELDS, info_fields);
+        mxSetField(info, 0, "sample_rate", mxCreateDoubleScalar(sample_rate));
+        mxSetField(info, 0, "sample_index", mxCreateDoubleScalar(sample_index));
+        mxSetField(info, 0, "dropped", mxCreateDoubleScalar(
+            (double) (reader.dropped - dropped) * samples_per_buffer));
+        plhs[1] = info;
+    }
+}
+#endif /* _WIN32 */
@@ -0,0 +1,23 @@
+function [samples, info] = hackrf_shm_read(name, num_samples, timeout)
+% Reads samples published by a HackRF Source block in shared memory
+%
+% SAMPLES = HACKRF_SHM_READ(NAME, NUM_SAMPLES) returns the next NUM_SAMPLES
+% complex samples (scaled to [-1, 1)) from the shared-memory segment NAME,
+% as set with the shm_name parameter of the source block. The first call
+% starts with the next buffer published, consecutive calls return
+% consecutive samples. The source is never slowed down by readers: a
+% reader that falls behind by more than the ring size skips ahead.
+%
+% SAMPLES = HACKRF_SHM_READ(NAME, NUM_SAMPLES, TIMEOUT) waits at most
+% TIMEOUT seconds (default 1) for new samples. On timeout fewer samples
+% are returned and the reader detaches, e.g. to pick up a restarted model.
+%
+% [SAMPLES, INFO] = HACKRF_SHM_READ(...) also returns a struct with
+%
+%   - sample_rate     sample rate of the source (Sps)
+%   - sample_index    index of the first sample in the published stream
+%   - dropped         samples skipped during this call
+%
+% HACKRF_SHM_READ() detaches from the segment.
+%
+% Not available on Windows.
@@ -21,16 +21,36 @@
 #define S_FUNCTION_LEVEL 2
 
 #include "common.h"
+#include "dsp.h"
 
 
 /* S-function params */
 enum SFcnParamsIndex_and_RWorkIndex {
     FREQUENCY, BANDWIDTH, TXVGA_GAIN,
+    NUM_MASK_PARAMS,
+    /* optional */
+    BURST_MODE = NUM_MASK_PARAMS, INTERPOLATION, FREQ_OFFSET, DEVICE_ADDRESS,
     NUM_PARAMS
 };
 enum PWorkIndex {
-    DEVICE = 0, SBUF, P_WORK_LENGTH
+    DEVICE = 0, SBUF, TX_STAGE, P_WORK_LENGTH
 };
+enum InputPortIndex {
+    SAMPLES = 0, VALID  /* valid input only in burst mode */
+};
+
+#define INTERPOLATOR_TAPS_PER_PHASE 24
+
+#define GetInterpolation() ((int) GetOptParam(INTERPOLATION, 1))
+
+
+/* optional interpolation and frequency shift while filling the ring */
+typedef struct {
+    Interpolator *interp;       /* NULL for no interpolation */
+    NCO nco;
+    double sample_rate;         /* device sample rate */
+    float *re, *im;             /* device rate samples of one input frame */
+} TxStage;
 
 
 /* ======================================================================== */
@@ -39,9 +59,22 @@ enum PWorkIndex {
 void mdlCheckParameters(SimStruct *S)
 /* ======================================================================== */
 {
+    Assert_num_params(S, NUM_MASK_PARAMS, NUM_PARAMS);
     Assert_is_numeric(S, FREQUENCY);
     Assert_is_numeric(S, BANDWIDTH);
     Assert_is_numeric(S, TXVGA_GAIN);
+    Assert_opt_is_numeric(S, BURST_MODE);
+    Assert_opt_is_numeric(S, INTERPOLATION);
+    Assert_opt_is_numeric(S, FREQ_OFFSET);
+    Assert_opt_is_string(S, DEVICE_ADDRESS);
+
+    /* frame size times factor must divide the buffer size */
+    if (!is_power_of_two(GetInterpolation()) ||
+        GetInterpolation() != GetOptParam(INTERPOLATION, 1) ||
+        GetInterpolation() > BUFFER_SIZE / BYTES_PER_SAMPLE) {
+        ssSetErrorStatus(S, "Interpolation must be a power of two (<= 2^17)")
+        return;
+    }
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -52,26 +85,35 @@ void mdlInitializeSizes(SimStruct *S)
 /* ======================================================================== */
 {
     /* parameters */
-    ssSetNumSFcnParams(S, NUM_PARAMS);
+    ssSetNumSFcnParams(S, -1);  /* trailing parameters are optional */
     #if defined(MATLAB_MEX_FILE)
-    if (ssGetNumSFcnParams(S) == ssGetSFcnParamsCount(S)) {
-        mdlCheckParameters(S);
-        if (ssGetErrorStatus(S) != NULL) return;
-    } else
-        return;
+    mdlCheckParameters(S);
+    if (ssGetErrorStatus(S) != NULL) return;
     #endif
     ssSetSFcnParamTunable(S, FREQUENCY,   SS_PRM_SIM_ONLY_TUNABLE);
     ssSetSFcnParamTunable(S, BANDWIDTH,   SS_PRM_NOT_TUNABLE);
     ssSetSFcnParamTunable(S, TXVGA_GAIN,  SS_PRM_SIM_ONLY_TUNABLE);
+    int i = NUM_MASK_PARAMS; for (; i < ssGetSFcnParamsCount(S); i++)
+        ssSetSFcnParamTunable(S, i, SS_PRM_NOT_TUNABLE);
+    if (ssGetSFcnParamsCount(S) > FREQ_OFFSET)
+        ssSetSFcnParamTunable(S, FREQ_OFFSET, SS_PRM_SIM_ONLY_TUNABLE);
 
     /* ports */
+    bool burst_mode = GetOptParam(BURST_MODE, 0) != 0;
     ssSetNumSampleTimes(S, 1);
-    if (!ssSetNumOutputPorts(S, 0) || !ssSetNumInputPorts(S, 1)) return;
-    ssSetInputPortWidth(S, 0, DYNAMICALLY_SIZED);
-    ssSetInputPortComplexSignal(S, 0, COMPLEX_YES);
-    ssSetInputPortDataType(S, 0, SS_INT8);
-    ssSetInputPortDirectFeedThrough(S, 0, true);
-    ssSetInputPortOptimOpts(S, 0, SS_REUSABLE_AND_LOCAL);
+    if (!ssSetNumOutputPorts(S, 0) || !ssSetNumInputPorts(S, burst_mode ? 2 : 1)) return;
+    ssSetInputPortWidth(S, SAMPLES, DYNAMICALLY_SIZED);
+    ssSetInputPortComplexSignal(S, SAMPLES, COMPLEX_YES);
+    ssSetInputPortDataType(S, SAMPLES, SS_INT8);
+    ssSetInputPortDirectFeedThrough(S, SAMPLES, true);
+    ssSetInputPortOptimOpts(S, SAMPLES, SS_REUSABLE_AND_LOCAL);
+    if (burst_mode) {
+        ssSetInputPortWidth(S, VALID, 1);
+        ssSetInputPortComplexSignal(S, VALID, COMPLEX_NO);
+        ssSetInputPortDataType(S, VALID, SS_BOOLEAN);
+        ssSetInputPortDirectFeedThrough(S, VALID, true);
+        ssSetInputPortOptimOpts(S, VALID, SS_REUSABLE_AND_LOCAL);
+    }
 
     /* work Vectors */
     ssSetNumPWork(S, P_WORK_LENGTH);
@@ -91,8 +133,9 @@ void mdlInitializeSizes(SimStruct *S)
 void mdlSetDefaultPortDimensionInfo(SimStruct *S)
 /* ========================================================================*/
 {
-    if (ssGetInputPortWidth(S, 0) == DYNAMICALLY_SIZED)
-        ssSetInputPortWidth(S, 0, BUFFER_SIZE / BYTES_PER_SAMPLE);
+    if (ssGetInputPortWidth(S, SAMPLES) == DYNAMICALLY_SIZED)
+        ssSetInputPortWidth(S, SAMPLES, BUFFER_SIZE / BYTES_PER_SAMPLE /
+                                        GetInterpolation());
 }
 #endif
 
@@ -103,10 +146,14 @@ void mdlSetDefaultPortDimensionInfo(SimStruct *S)
 void mdlSetInputPortDimensionInfo(SimStruct *S, int_T port, const DimsInfo_T *dimsInfo)
 /* ========================================================================*/
 {
-    if (dimsInfo->numDims >= 2 && dimsInfo->dims[1] > 1)
+    if (port == VALID && dimsInfo->width != 1)
+        ssSetErrorStatus(S, "Valid input must be a scalar")
+    else if (port == VALID)
+        ssSetInputPortDimensionInfo(S, port, dimsInfo);
+    else if (dimsInfo->numDims >= 2 && dimsInfo->dims[1] > 1)
         ssSetErrorStatus(S, "Wrong port dimensions")
-    else if (BUFFER_SIZE / BYTES_PER_SAMPLE % dimsInfo->dims[0])
-        ssSetErrorStatus(S, "Frame size must be a power of two (<= 2^18)")
+    else if (BUFFER_SIZE / BYTES_PER_SAMPLE % (dimsInfo->dims[0] * GetInterpolation()))
+        ssSetErrorStatus(S, "Frame size times interpolation must be a power of two (<= 2^18)")
     else
         ssSetInputPortDimensionInfo(S, port, dimsInfo);
 }
@@ -129,6 +176,80 @@ void mdlProcessParameters(SimStruct *S);
 static int hackrf_tx_callback(hackrf_transfer *transfer);
 
 
+static signed char saturate_int8(float value)
+{
+    value = (value < -128.0f) ? -128.0f : (value > 127.0f) ? 127.0f : value;
+    return (signed char) lrintf(value);
+}
+
+
+/* ======================================================================== */
+static TxStage *tx_stage_new(SimStruct *S)
+/* ======================================================================== */
+{
+    int width = ssGetInputPortWidth(S, SAMPLES), factor = GetInterpolation();
+    TxStage *stage = calloc(1, sizeof(TxStage));
+    if (factor > 1)
+        stage->interp = interpolator_new(factor, INTERPOLATOR_TAPS_PER_PHASE, width);
+    stage->re = malloc(width * factor * sizeof(float));
+    stage->im = malloc(width * factor * sizeof(float));
+    return stage;
+}
+
+
+/* ======================================================================== */
+static void tx_stage_reset(TxStage *stage, double sample_rate)
+/* ======================================================================== */
+{
+    if (stage->interp) interpolator_reset(stage->interp);
+    nco_reset(&stage->nco);
+    stage->sample_rate = sample_rate;
+}
+
+
+/* ======================================================================== */
+static void tx_stage_free(TxStage *stage)
+/* ======================================================================== */
+{
+    if (stage->interp) interpolator_free(stage->interp);
+    free(stage->re);
+    free(stage->im);
+    free(stage);
+}
+
+
+/* ======================================================================== */
+static size_t tx_stage_process(SimStruct *S, TxStage *stage, const signed char *in,
+                               int count, unsigned char *out)
+/* ======================================================================== */
+{
+    int n = 0;
+    stage->nco.frequency = GetOptParam(FREQ_OFFSET, 0) / stage->sample_rate;
+    if (!stage->interp && stage->nco.frequency == 0.0) {
+        /* nothing to do, e.g. only the device address follows the offset */
+        memcpy(out, in, 2 * (size_t) count);
+        return 2 * (size_t) count;
+    }
+    if (stage->interp) {
+        interpolator_process(stage->interp, in, count, stage->re, stage->im);
+        count *= stage->interp->factor;
+    } else
+        for (; n < count; n++) {
+            stage->re[n] = in[2 * n];
+            stage->im[n] = in[2 * n + 1];
+        }
+
+    nco_mix(&stage->nco, stage->re, stage->im, count);
+
+    signed char *iq = (signed char*) out;
+    for (n = 0; n < count; n++) {
+        iq[2 * n]     = saturate_int8(stage->re[n]);
+        iq[2 * n + 1] = saturate_int8(stage->im[n]);
+    }
+    return 2 * (size_t) count;
+}
+
+
 /* ======================================================================== */
 #define MDL_START
 void mdlStart(SimStruct *S)
@@ -137,6 +258,8 @@ void mdlStart(SimStruct *S)
     int i = 0; for (; i < P_WORK_LENGTH; ++i) ssSetPWorkValue(S, i, NULL);
 
     ssSetPWorkValue(S, SBUF, sample_buffer_new());
+    if (GetInterpolation() > 1 || ssGetSFcnParamsCount(S) > FREQ_OFFSET)
+        ssSetPWorkValue(S, TX_STAGE, tx_stage_new(S));
 
     Hackrf_assert(S, hackrf_init(), "Failed to initialize HackRF API");
     startHackrfTx(S, true);
@@ -147,16 +270,23 @@ void mdlStart(SimStruct *S)
 static void startHackrfTx(SimStruct *S, bool print_info)
 /* ======================================================================== */
 {
-    double sample_rate = (1.0 / ssGetSampleTime(S, 0)) * ssGetInputPortDimensions(S, 0)[0];
-    hackrf_device *device = startHackrf(S, sample_rate, GetParam(BANDWIDTH), print_info);
+    double sample_rate = (1.0 / ssGetSampleTime(S, 0)) *
+                         ssGetInputPortDimensions(S, SAMPLES)[0] * GetInterpolation();
+    char address[256];
+    get_opt_string(S, DEVICE_ADDRESS, address, sizeof(address));
+    Device *device = startHackrf(S, address, sample_rate, GetParam(BANDWIDTH), print_info);
     ssSetPWorkValue(S, DEVICE, device);
     if (ssGetErrorStatus(S)) return;
 
     int i = 0; for (; i < NUM_PARAMS; i++) ssSetRWorkValue(S, i, NAN);
     mdlProcessParameters(S);
 
-    sample_buffer_reset((SampleBuffer*) ssGetPWorkValue(S, SBUF));
-    int ret = hackrf_start_tx(device, hackrf_tx_callback, S);
+    SampleBuffer *sbuf = ssGetPWorkValue(S, SBUF);
+    sample_buffer_reset(sbuf);
+    sbuf->idle = GetOptParam(BURST_MODE, 0) != 0;  /* wait for first burst */
+    TxStage *stage = ssGetPWorkValue(S, TX_STAGE);
+    if (stage) tx_stage_reset(stage, sample_rate);
+    int ret = device_start_tx(device, hackrf_tx_callback, S);
     Hackrf_assert(S, ret, "Failed to start RX streaming");
 }
 
@@ -167,9 +297,9 @@ void mdlProcessParameters(SimStruct *S)
 /* ========================================================================*/
 {
     if(!ssGetPWorkValue(S, DEVICE)) return;
-    Hackrf_set_param(S, hackrf_set_freq, uint64_t, FREQUENCY,
+    Hackrf_set_param(S, DEVICE_FREQ, FREQUENCY,
                      "Failed to set center frequency");
-    Hackrf_set_param(S, hackrf_set_txvga_gain, uint32_t, TXVGA_GAIN,
+    Hackrf_set_param(S, DEVICE_TXVGA_GAIN, TXVGA_GAIN,
                      "Failed to set TXVGA gain (range 0-47 step 1db)");
 }
 
@@ -198,6 +328,9 @@ static int hackrf_tx_callback(hackrf_transfer *transfer)
         pthread_cond_signal(&sbuf->cond_var);
         pthread_mutex_unlock(&sbuf->mutex);
 
+    } else if (sbuf->idle) {  /* between bursts, send silence */
+        memset(transfer->buffer, 0, (size_t) transfer->valid_length);
+
     } else {  /* underrun, no buffers ready */
         memset(transfer->buffer, 0, (size_t) transfer->valid_length);
         sbuf->error = SB_UNDERRUN;
@@ -207,6 +340,77 @@ static int hackrf_tx_callback(hackrf_transfer *transfer)
 }
 
 
+/* ======================================================================== */
+static void commit_buffer(SampleBuffer *sbuf)
+/* ======================================================================== */
+{
+    sbuf->offset = 0;
+    if (++sbuf->tail >= NUMBER_OF_BUFFERS) sbuf->tail = 0;
+    pthread_mutex_lock(&sbuf->mutex);
+    sbuf->ready += 1;
+    sbuf->idle = false;
+    pthread_mutex_unlock(&sbuf->mutex);
+}
+
+
+/* ======================================================================== */
+static bool wait_for_buffer(SimStruct *S, SampleBuffer *sbuf)
+/* ======================================================================== */
+{
+    pthread_mutex_lock(&sbuf->mutex);
+    /* loop, after a spurious wakeup tail would still be the head buffer */
+    while (sbuf->ready == NUMBER_OF_BUFFERS) {
+        Device *device = ssGetPWorkValue(S, DEVICE);
+        if (device_is_streaming(device) != HACKRF_TRUE) {
+            ssSetErrorStatus(S, "Streaming to device stopped");
+            pthread_mutex_unlock(&sbuf->mutex);
+            return false;
+        }
+        pthread_cond_wait(&sbuf->cond_var, &sbuf->mutex);
+    }
+    pthread_mutex_unlock(&sbuf->mutex);
+    return true;
+}
+
+
+/* ======================================================================== */
+static void drain_tx_stage(SimStruct *S, SampleBuffer *sbuf, TxStage *stage)
+/* ======================================================================== */
+{
+    /* feed zeros until the interpolator history is out, else the group
+       delay cuts off the end of the burst */
+    static const signed char zeros[2 * (INTERPOLATOR_TAPS_PER_PHASE - 1)];
+    int width = ssGetInputPortWidth(S, SAMPLES),
+        remaining = INTERPOLATOR_TAPS_PER_PHASE - 1;
+    while (remaining > 0) {
+        /* chunks of at most one frame, which always fit the buffer */
+        int count = (remaining < width) ? remaining : width;
+        if (!wait_for_buffer(S, sbuf)) return;
+        sbuf->offset += tx_stage_process(S, stage, zeros, count,
+                                         sbuf->buffers[sbuf->tail] + sbuf->offset);
+        if (sbuf->offset >= BUFFER_SIZE)
+            commit_buffer(sbuf);
+        remaining -= count;
+    }
+}
+
+
+/* ======================================================================== */
+static void flush_burst(SampleBuffer *sbuf)
+/* ======================================================================== */
+{
+    /* zero-pad the partial buffer and hand it to the device */
+    if (sbuf->offset) {
+        memset(sbuf->buffers[sbuf->tail] + sbuf->offset, 0,
+               BUFFER_SIZE - sbuf->offset);
+        commit_buffer(sbuf);
+    }
+    pthread_mutex_lock(&sbuf->mutex);
+    sbuf->idle = true;
+    pthread_mutex_unlock(&sbuf->mutex);
+}
+
+
 /* ======================================================================== */
 #define MDL_OUTPUTS
 void mdlOutputs(SimStruct *S, int_T tid)
@@ -221,31 +425,36 @@ void mdlOutputs(SimStruct *S, int_T tid)
         sbuf->error = SB_NO_ERROR;
     }
 
-    pthread_mutex_lock(&sbuf->mutex);
-    if(sbuf->ready == NUMBER_OF_BUFFERS) {
-        hackrf_device* device = ssGetPWorkValue(S, DEVICE);
-        if (hackrf_is_streaming(device) == HACKRF_TRUE) {
-            pthread_cond_wait(&sbuf->cond_var, &sbuf->mutex);
-        } else {
-            ssSetErrorStatus(S, "Streaming to device stopped");
-            pthread_mutex_unlock(&sbuf->mutex);
+    TxStage *stage = ssGetPWorkValue(S, TX_STAGE);
+    if (ssGetNumInputPorts(S) > VALID) {
+        bool valid = *(const boolean_T*) ssGetInputPortSignalPtrs(S, VALID)[0];
+        if (!valid) {
+            /* falling edge of valid marks the end of a burst, which may
+               not have filled a whole buffer yet */
+            if (sbuf->offset || !sbuf->idle) {
+                if (stage && stage->interp) drain_tx_stage(S, sbuf, stage);
+                flush_burst(sbuf);
+                if (stage) tx_stage_reset(stage, stage->sample_rate);
+            }
             return;
         }
     }
-    pthread_mutex_unlock(&sbuf->mutex);
 
-    size_t len_in = 2 * (size_t) ssGetInputPortWidth(S, 0);
-    memcpy(sbuf->buffers[sbuf->tail] + sbuf->offset,
-           ssGetInputPortSignalPtrs(S, 0)[0], len_in);
-    sbuf->offset += len_in;
-
-    if (sbuf->offset >= BUFFER_SIZE) {
-        sbuf->offset = 0;
-        if (++sbuf->tail >= NUMBER_OF_BUFFERS) sbuf->tail = 0;
-        pthread_mutex_lock(&sbuf->mutex);
-        sbuf->ready += 1;
-        pthread_mutex_unlock(&sbuf->mutex);
+    if (!wait_for_buffer(S, sbuf)) return;
+
+    unsigned char *out = sbuf->buffers[sbuf->tail] + sbuf->offset;
+    const void *in = ssGetInputPortSignalPtrs(S, SAMPLES)[0];
+    if (stage)
+        sbuf->offset += tx_stage_process(S, stage, in,
+                                         ssGetInputPortWidth(S, SAMPLES), out);
+    else {
+        size_t len_in = 2 * (size_t) ssGetInputPortWidth(S, SAMPLES);
+        memcpy(out, in, len_in);
+        sbuf->offset += len_in;
     }
+
+    if (sbuf->offset >= BUFFER_SIZE)
+        commit_buffer(sbuf);
 }
 
 
@@ -279,6 +488,11 @@ void mdlTerminate(SimStruct *S)
         sample_buffer_free(sbuf);
         ssSetPWorkValue(S, SBUF, NULL);
     }
+    TxStage *stage = ssGetPWorkValue(S, TX_STAGE);
+    if (stage) {
+        tx_stage_free(stage);
+        ssSetPWorkValue(S, TX_STAGE, NULL);
+    }
 }
 
 
@@ -20,21 +20,102 @@
 #define S_FUNCTION_NAME hackrf_source
 #define S_FUNCTION_LEVEL 2
 
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/timeb.h>
+#endif
+
 #include "common.h"
+#include "channelizer.h"
+#include "agc.h"
 
 
 /* S-function params */
 enum SFcnParamsIndex_and_RWorkIndex {
     SAMPLE_RATE = 0, FREQUENCY, BANDWIDTH,
     AMP_ENABLE, LNA_GAIN, VGA_GAIN, FRAME_SIZE, USE_DOUBLE,
+    NUM_MASK_PARAMS,
+    /* optional */
+    TRIGGER_LEVEL = NUM_MASK_PARAMS, PRE_TRIGGER, POST_TRIGGER,
+    NUM_CHANNELS, CHANNELS, OVERSAMPLING, NUM_THREADS,
+    AGC_TARGET, AGC_HYSTERESIS, BATCH_FRAMES, SHM_NAME, DEVICE_ADDRESS,
     NUM_PARAMS
 };
 
 enum PWorkIndex {
-    DEVICE = 0, SBUF, LUT,
+    DEVICE = 0, SBUF, LUT, TRIGGER, CHANNELIZER, AGC,
     P_WORK_LENGTH
 };
 
+enum OutputPortIndex {
+    SAMPLES = 0,                /* first selected channel in channelizer mode */
+    FRAME_VALID, TRIGGER_INDEX, /* trigger mode only */
+    BATCH_COUNT = FRAME_VALID   /* batch mode only */
+    /* AGC mode adds AGC_GAIN, AGC_CHANGE as the last two ports */
+};
+
+#define AGC_PORTS 2
+
+#define TRIGGER_IDLE_TIMEOUT 0.1  /* max. time a step waits for a trigger (s) */
+
+
+/* ======================================================================== */
+
+
+/* In trigger mode the ring is addressed in frames. The callback writes
+   every transfer, but only releases frames around a trigger to mdlOutputs.
+   Unreleased frames are kept as pre-trigger history or skipped. */
+typedef struct {
+    int frame_samples, frames_per_buffer, num_frames;
+    int threshold;                  /* on squared magnitude of raw samples */
+    int pre, post;                  /* frames released before/after a trigger */
+
+    uint64_t written;               /* next frame written by callback */
+    uint64_t released;              /* frames before this may be read */
+    uint64_t read;                  /* next frame to be read */
+    uint64_t dropped;               /* frames lost to overruns */
+    int post_remaining;
+    double trigger_index;           /* sample index of the current trigger */
+
+    bool *valid;                    /* per frame: part of a capture */
+    double *trigger;                /* per frame: trigger index of capture */
+} TriggerState;
+
+
+/* ======================================================================== */
+static int get_channels(SimStruct *S, int *channels)
+/* ======================================================================== */
+{
+    /* selected channels of the channelizer, all if none given */
+    int num_channels = (int) GetOptParam(NUM_CHANNELS, 0), i = 0;
+    if (ssGetSFcnParamsCount(S) > CHANNELS && !mxIsEmpty(ssGetSFcnParam(S, CHANNELS))) {
+        const mxArray *param = ssGetSFcnParam(S, CHANNELS);
+        int count = (int) mxGetNumberOfElements(param);
+        if (channels)
+            for (; i < count; i++) channels[i] = (int) mxGetPr(param)[i];
+        return count;
+    }
+    if (channels)
+        for (; i < num_channels; i++) channels[i] = i;
+    return num_channels;
+}
+
+
+/* ======================================================================== */
+static void get_shm_name(SimStruct *S, char *name)
+/* ======================================================================== */
+{
+    /* POSIX name of the shared sample ring, empty if not shared */
+    char param[HACKRF_SHM_NAME_MAX - 1];
+    get_opt_string(S, SHM_NAME, param, sizeof(param));
+    if (param[0] && param[0] != '/')
+        snprintf(name, HACKRF_SHM_NAME_MAX, "/%s", param);
+    else
+        strcpy(name, param);
+}
+
 
 /* ======================================================================== */
 #if defined(MATLAB_MEX_FILE)
@@ -42,6 +123,7 @@ enum PWorkIndex {
 void mdlCheckParameters(SimStruct *S)
 /* ======================================================================== */
 {
+    Assert_num_params(S, NUM_MASK_PARAMS, NUM_PARAMS);
     Assert_is_numeric(S, SAMPLE_RATE);
     Assert_is_numeric(S, FREQUENCY);
     Assert_is_numeric(S, BANDWIDTH);
@@ -50,11 +132,100 @@ void mdlCheckParameters(SimStruct *S)
     Assert_is_numeric(S, VGA_GAIN);
     Assert_is_numeric(S, FRAME_SIZE);
     Assert_is_numeric(S, USE_DOUBLE);
+    Assert_opt_is_numeric(S, TRIGGER_LEVEL);
+    Assert_opt_is_numeric(S, PRE_TRIGGER);
+    Assert_opt_is_numeric(S, POST_TRIGGER);
+    Assert_opt_is_numeric(S, NUM_CHANNELS);
+    Assert_opt_is_numeric(S, OVERSAMPLING);
+    Assert_opt_is_numeric(S, NUM_THREADS);
+    Assert_opt_is_numeric(S, AGC_TARGET);
+    Assert_opt_is_numeric(S, AGC_HYSTERESIS);
+    Assert_opt_is_numeric(S, BATCH_FRAMES);
+    Assert_opt_is_string(S, DEVICE_ADDRESS);
+    if (ssGetSFcnParamsCount(S) > CHANNELS &&
+            (!mxIsDouble(ssGetSFcnParam(S, CHANNELS)) ||
+             mxIsComplex(ssGetSFcnParam(S, CHANNELS)))) {
+        /* get_channels reads the elements through mxGetPr */
+        ssSetErrorStatus(S, "Parameter 'CHANNELS' must be a real double vector")
+        return;
+    }
+    if (ssGetSFcnParamsCount(S) > SHM_NAME &&
+            (!mxIsChar(ssGetSFcnParam(S, SHM_NAME)) ||
+             mxGetNumberOfElements(ssGetSFcnParam(S, SHM_NAME)) > HACKRF_SHM_NAME_MAX - 2)) {
+        ssSetErrorStatusf(S, "Parameter 'SHM_NAME' must be a string (max. %d chars)",
+                          HACKRF_SHM_NAME_MAX - 2);
+        return;
+    }
 
     if (BUFFER_SIZE / BYTES_PER_SAMPLE % (int) GetParam(FRAME_SIZE)) {
         ssSetErrorStatus(S, "Frame size must be a power of two (<= 2^18)")
         return;
     }
+    double level = GetOptParam(TRIGGER_LEVEL, 0);
+    if (level < 0 || level >= 1) {
+        ssSetErrorStatus(S, "Trigger level must be in [0, 1)")
+        return;
+    }
+    double agc_target = GetOptParam(AGC_TARGET, 0);
+    if (agc_target < 0 || agc_target >= 1 || GetOptParam(AGC_HYSTERESIS, 3) < 0) {
+        ssSetErrorStatus(S, "AGC target must be in [0, 1), hysteresis positive")
+        return;
+    }
+    if (agc_target > 0 && level > 0) {
+        ssSetErrorStatus(S, "AGC and trigger mode can not be combined")
+        return;
+    }
+    int batch = (int) GetOptParam(BATCH_FRAMES, 1);
+    if (batch < 1 || batch * GetParam(FRAME_SIZE) >
+            (NUMBER_OF_BUFFERS - 1) * BUFFER_SIZE / BYTES_PER_SAMPLE) {
+        ssSetErrorStatus(S, "Batch frames must be positive and fit into the sample buffer")
+        return;
+    }
+    if (batch > 1 && (level > 0 || GetOptParam(NUM_CHANNELS, 0))) {
+        ssSetErrorStatus(S, "Batch mode can not be combined with trigger or channelizer mode")
+        return;
+    }
+    char shm_name[HACKRF_SHM_NAME_MAX];
+    get_shm_name(S, shm_name);
+    if (shm_name[0] && level > 0) {
+        ssSetErrorStatus(S, "Shared memory output can not be combined with trigger mode")
+        return;
+    }
+    double history = GetOptParam(PRE_TRIGGER, 1) * GetParam(FRAME_SIZE);
+    if (GetOptParam(PRE_TRIGGER, 1) < 0 || GetOptParam(POST_TRIGGER, 1) < 0 ||
+        history > (NUMBER_OF_BUFFERS - 1) * BUFFER_SIZE / BYTES_PER_SAMPLE) {
+        ssSetErrorStatus(S, "Pre-trigger history must fit into the sample buffer")
+        return;
+    }
+
+    int num_channels = (int) GetOptParam(NUM_CHANNELS, 0);
+    if (!num_channels) return;
+    int oversampling = (int) GetOptParam(OVERSAMPLING, 1);
+    if (!is_power_of_two(num_channels) || num_channels < 2) {
+        ssSetErrorStatus(S, "Number of channels must be a power of two")
+        return;
+    }
+    if (oversampling != 1 && oversampling != 2) {
+        ssSetErrorStatus(S, "Channelizer oversampling must be 1 or 2")
+        return;
+    }
+    if ((int) GetParam(FRAME_SIZE) % (num_channels / oversampling)) {
+        ssSetErrorStatus(S, "Frame size must be a multiple of the channel decimation")
+        return;
+    }
+    if (level > 0) {
+        ssSetErrorStatus(S, "Channelizer and trigger mode can not be combined")
+        return;
+    }
+    int count = get_channels(S, NULL), *channels = malloc(count * sizeof(int)), i = 0;
+    get_channels(S, channels);
+    for (; i < count; i++)
+        if (channels[i] < -num_channels || channels[i] >= num_channels) break;
+    free(channels);
+    if (i < count) {
+        ssSetErrorStatus(S, "Channels must be in the range -N .. N-1")
+        return;
+    }
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -65,13 +236,10 @@ void mdlInitializeSizes(SimStruct *S)
 /* ======================================================================== */
 {
     /* parameters */
-    ssSetNumSFcnParams(S, NUM_PARAMS);
+    ssSetNumSFcnParams(S, -1);  /* trailing parameters are optional */
     #if defined(MATLAB_MEX_FILE)
-    if (ssGetNumSFcnParams(S) == ssGetSFcnParamsCount(S)) {
-        mdlCheckParameters(S);
-        if (ssGetErrorStatus(S) != NULL) return;
-    } else
-        return;
+    mdlCheckParameters(S);
+    if (ssGetErrorStatus(S) != NULL) return;
     #endif
     ssSetSFcnParamTunable(S, SAMPLE_RATE, SS_PRM_NOT_TUNABLE);
     ssSetSFcnParamTunable(S, FREQUENCY,   SS_PRM_SIM_ONLY_TUNABLE);
@@ -80,14 +248,61 @@ void mdlInitializeSizes(SimStruct *S)
     ssSetSFcnParamTunable(S, LNA_GAIN,    SS_PRM_SIM_ONLY_TUNABLE);
     ssSetSFcnParamTunable(S, AMP_ENABLE,  SS_PRM_SIM_ONLY_TUNABLE);
     ssSetSFcnParamTunable(S, FRAME_SIZE,  SS_PRM_NOT_TUNABLE);
+    int i = NUM_MASK_PARAMS; for (; i < ssGetSFcnParamsCount(S); i++)
+        ssSetSFcnParamTunable(S, i, SS_PRM_NOT_TUNABLE);
 
     /* ports */
+    bool trigger_mode = GetOptParam(TRIGGER_LEVEL, 0) > 0;
+    int num_channels = (int) GetOptParam(NUM_CHANNELS, 0);
+    bool agc_mode = GetOptParam(AGC_TARGET, 0) > 0;
+    int batch = (int) GetOptParam(BATCH_FRAMES, 1);
+    int num_outputs = num_channels ? get_channels(S, NULL) : trigger_mode ? 3 :
+                      (batch > 1) ? 2 : 1;
+    if (agc_mode) num_outputs += AGC_PORTS;
     ssSetNumSampleTimes(S, 1);
-    if (!ssSetNumInputPorts(S, 0) || !ssSetNumOutputPorts(S, 1)) return;
-    ssSetOutputPortWidth(S, 0, (int) GetParam(FRAME_SIZE));
-    ssSetOutputPortComplexSignal(S, 0, COMPLEX_YES);
-    ssSetOutputPortDataType(S, 0, (GetParam(USE_DOUBLE)) ? SS_DOUBLE : SS_INT8);
-    ssSetOutputPortOptimOpts(S, 0, SS_REUSABLE_AND_LOCAL);
+    if (!ssSetNumInputPorts(S, 0) || !ssSetNumOutputPorts(S, num_outputs)) return;
+    if (num_channels) {
+        /* one port per selected channel */
+        int decimation = num_channels / (int) GetOptParam(OVERSAMPLING, 1);
+        for (i = 0; i < num_outputs; i++) {
+            ssSetOutputPortWidth(S, i, (int) GetParam(FRAME_SIZE) / decimation);
+            ssSetOutputPortComplexSignal(S, i, COMPLEX_YES);
+            ssSetOutputPortDataType(S, i, SS_DOUBLE);
+            ssSetOutputPortOptimOpts(S, i, SS_REUSABLE_AND_LOCAL);
+        }
+    } else {
+        if (batch > 1)  /* one frame per column */
+            ssSetOutputPortMatrixDimensions(S, SAMPLES, (int) GetParam(FRAME_SIZE), batch);
+        else
+            ssSetOutputPortWidth(S, SAMPLES, (int) GetParam(FRAME_SIZE));
+        ssSetOutputPortComplexSignal(S, SAMPLES, COMPLEX_YES);
+        ssSetOutputPortDataType(S, SAMPLES, (GetParam(USE_DOUBLE)) ? SS_DOUBLE : SS_INT8);
+        ssSetOutputPortOptimOpts(S, SAMPLES, SS_REUSABLE_AND_LOCAL);
+    }
+    if (trigger_mode) {
+        ssSetOutputPortWidth(S, FRAME_VALID, 1);
+        ssSetOutputPortComplexSignal(S, FRAME_VALID, COMPLEX_NO);
+        ssSetOutputPortDataType(S, FRAME_VALID, SS_BOOLEAN);
+        ssSetOutputPortWidth(S, TRIGGER_INDEX, 1);
+        ssSetOutputPortComplexSignal(S, TRIGGER_INDEX, COMPLEX_NO);
+        ssSetOutputPortDataType(S, TRIGGER_INDEX, SS_DOUBLE);
+    }
+    if (batch > 1) {
+        /* number of valid columns in the sample matrix */
+        ssSetOutputPortWidth(S, BATCH_COUNT, 1);
+        ssSetOutputPortComplexSignal(S, BATCH_COUNT, COMPLEX_NO);
+        ssSetOutputPortDataType(S, BATCH_COUNT, SS_DOUBLE);
+    }
+    if (agc_mode) {
+        /* [LNA VGA] gain in effect and sample index of the last change */
+        int port = num_outputs - AGC_PORTS;
+        ssSetOutputPortWidth(S, port, 2);
+        ssSetOutputPortComplexSignal(S, port, COMPLEX_NO);
+        ssSetOutputPortDataType(S, port, SS_DOUBLE);
+        ssSetOutputPortWidth(S, port + 1, 1);
+        ssSetOutputPortComplexSignal(S, port + 1, COMPLEX_NO);
+        ssSetOutputPortDataType(S, port + 1, SS_DOUBLE);
+    }
 
     /* work vectors */
     ssSetNumPWork(S, P_WORK_LENGTH);
@@ -116,6 +331,44 @@ void mdlProcessParameters(SimStruct *S);
 static int hackrf_rx_callback(hackrf_transfer *transfer);
 
 
+/* ======================================================================== */
+static TriggerState *trigger_state_new(SimStruct *S)
+/* ======================================================================== */
+{
+    TriggerState *trig = calloc(1, sizeof(TriggerState));
+    trig->frame_samples = (int) GetParam(FRAME_SIZE);
+    trig->frames_per_buffer = BUFFER_SIZE / BYTES_PER_SAMPLE / trig->frame_samples;
+    trig->num_frames = NUMBER_OF_BUFFERS * trig->frames_per_buffer;
+    double level = 128.0 * GetOptParam(TRIGGER_LEVEL, 0);
+    trig->threshold = (int) (level * level);
+    trig->pre = (int) GetOptParam(PRE_TRIGGER, 1);
+    trig->post = (int) GetOptParam(POST_TRIGGER, 1);
+    trig->valid = calloc((size_t) trig->num_frames, sizeof(bool));
+    trig->trigger = calloc((size_t) trig->num_frames, sizeof(double));
+    return trig;
+}
+
+
+/* ======================================================================== */
+static void trigger_state_reset(TriggerState *trig)
+/* ======================================================================== */
+{
+    trig->written = trig->released = trig->read = trig->dropped = 0;
+    trig->post_remaining = 0;
+    trig->trigger_index = -1;
+}
+
+
+/* ======================================================================== */
+static void trigger_state_free(TriggerState *trig)
+/* ======================================================================== */
+{
+    free(trig->valid);
+    free(trig->trigger);
+    free(trig);
+}
+
+
 /* ======================================================================== */
 #define MDL_START
 void mdlStart(SimStruct *S)
@@ -123,7 +376,37 @@ void mdlStart(SimStruct *S)
 {
     int i = 0; for (; i < P_WORK_LENGTH; i++) ssSetPWorkValue(S, i, NULL);
 
-    ssSetPWorkValue(S, SBUF, sample_buffer_new());
+    char shm_name[HACKRF_SHM_NAME_MAX];
+    get_shm_name(S, shm_name);
+    if (shm_name[0]) {
+        SampleBuffer *sbuf = sample_buffer_new_shared(shm_name, GetParam(SAMPLE_RATE));
+        if (!sbuf && errno == EBUSY) {
+            ssSetErrorStatusf(S, "Shared memory %s is in use by another running source",
+                              shm_name);
+            return;
+        }
+        if (!sbuf) {
+            ssSetErrorStatusf(S, "Failed to create shared memory %s: %s",
+                              shm_name, strerror(errno));
+            return;
+        }
+        ssSetPWorkValue(S, SBUF, sbuf);
+        ssPrintf("Publishing samples in shared memory %s\n", shm_name);
+    } else
+        ssSetPWorkValue(S, SBUF, sample_buffer_new());
+    int num_channels = (int) GetOptParam(NUM_CHANNELS, 0);
+    if (GetOptParam(AGC_TARGET, 0) > 0)
+        ssSetPWorkValue(S, AGC, agc_new(GetOptParam(AGC_TARGET, 0),
+                                        GetOptParam(AGC_HYSTERESIS, 3)));
+    if (num_channels) {
+        int count = get_channels(S, NULL), *channels = malloc(count * sizeof(int));
+        get_channels(S, channels);
+        ssSetPWorkValue(S, CHANNELIZER, channelizer_new(
+            num_channels, (int) GetOptParam(OVERSAMPLING, 1), channels, count,
+            (int) GetParam(FRAME_SIZE), (int) GetOptParam(NUM_THREADS, 0)));
+        free(channels);
+    } else if (GetOptParam(TRIGGER_LEVEL, 0) > 0)
+        ssSetPWorkValue(S, TRIGGER, trigger_state_new(S));
 
     if (GetParam(USE_DOUBLE)) {
         real_T *lut = malloc(256 * sizeof(real_T));
@@ -140,8 +423,10 @@ void mdlStart(SimStruct *S)
 static void startHackrfRx(SimStruct *S, bool print_info)
 /* ======================================================================== */
 {
-    hackrf_device *device = startHackrf(S, (int) GetParam(SAMPLE_RATE),
-                                        GetParam(BANDWIDTH), print_info);
+    char address[256];
+    get_opt_string(S, DEVICE_ADDRESS, address, sizeof(address));
+    Device *device = startHackrf(S, address, (int) GetParam(SAMPLE_RATE),
+                                 GetParam(BANDWIDTH), print_info);
     ssSetPWorkValue(S, DEVICE, device);
     if (ssGetErrorStatus(S)) return;
 
@@ -149,7 +434,15 @@ static void startHackrfRx(SimStruct *S, bool print_info)
     mdlProcessParameters(S);
 
     sample_buffer_reset((SampleBuffer*) ssGetPWorkValue(S, SBUF));
-    int ret = hackrf_start_rx(device, hackrf_rx_callback, S);
+    TriggerState *trig = ssGetPWorkValue(S, TRIGGER);
+    if (trig) trigger_state_reset(trig);
+    Channelizer *ch = ssGetPWorkValue(S, CHANNELIZER);
+    if (ch) channelizer_reset(ch);
+    /* before streaming, the callback feeds the AGC from the first transfer */
+    Agc *agc = ssGetPWorkValue(S, AGC);
+    if (agc) agc_start(agc, device, (int) GetParam(LNA_GAIN), (int) GetParam(VGA_GAIN));
+
+    int ret = device_start_rx(device, hackrf_rx_callback, S);
     Hackrf_assert(S, ret, "Failed to start RX streaming");
 }
 
@@ -161,23 +454,105 @@ void mdlProcessParameters(SimStruct *S)
 {
     if(!ssGetPWorkValue(S, DEVICE)) return;
 
-    Hackrf_set_param(S, hackrf_set_freq, uint64_t, FREQUENCY,
+    Hackrf_set_param(S, DEVICE_FREQ, FREQUENCY,
                      "Failed to set center frequency");
-    Hackrf_set_param(S, hackrf_set_amp_enable, uint8_t, AMP_ENABLE,
+    Hackrf_set_param(S, DEVICE_AMP_ENABLE, AMP_ENABLE,
                      "Failed to enable external amp");
-    Hackrf_set_param(S, hackrf_set_lna_gain, uint32_t, LNA_GAIN,
+    Agc *agc = ssGetPWorkValue(S, AGC);
+    if (agc && agc->running) return;  /* gains are controlled by the AGC */
+    Hackrf_set_param(S, DEVICE_LNA_GAIN, LNA_GAIN,
                      "Failed to set LNA gain (range 0-40 step 8db)");
-    Hackrf_set_param(S, hackrf_set_vga_gain, uint32_t, VGA_GAIN,
+    Hackrf_set_param(S, DEVICE_VGA_GAIN, VGA_GAIN,
                      "Failed to set VGA gain (range 0-62 step 2db)");
 }
 
 
+/* ======================================================================== */
+static int detect_trigger(const signed char *iq, int samples, int threshold)
+/* ======================================================================== */
+{
+    /* index of first sample above threshold, or -1 */
+    int i = 0; for (; i < samples; i++) {
+        int re = iq[2 * i], im = iq[2 * i + 1];
+        if (re * re + im * im > threshold) return i;
+    }
+    return -1;
+}
+
+
+/* ======================================================================== */
+static void trigger_rx(SampleBuffer *sbuf, TriggerState *trig,
+                       const unsigned char *data)
+/* ======================================================================== */
+{
+    pthread_mutex_lock(&sbuf->mutex);
+    if (trig->released == trig->read) {
+        /* consumer is idle: discard history older than the pre-trigger */
+        uint64_t keep_from = (trig->written > (uint64_t) trig->pre) ?
+                             trig->written - trig->pre : 0;
+        if (keep_from > trig->read) trig->read = trig->released = keep_from;
+    }
+    bool overrun = trig->written + trig->frames_per_buffer - trig->read >
+                   (uint64_t) trig->num_frames;
+    pthread_mutex_unlock(&sbuf->mutex);
+
+    if (overrun) {
+        trig->dropped += trig->frames_per_buffer;
+        sbuf->had_error = true;
+        sbuf->error = SB_OVERRUN;
+        return;
+    }
+
+    /* the written frames are not visible to the consumer until released */
+    size_t slot = (trig->written / trig->frames_per_buffer) % NUMBER_OF_BUFFERS;
+    memcpy(sbuf->buffers[slot], data, BUFFER_SIZE);
+
+    uint64_t released = trig->released;
+    int k = 0; for (; k < trig->frames_per_buffer; k++) {
+        uint64_t frame = trig->written + k;
+        const signed char *iq = (const signed char*) data +
+                                (size_t) k * trig->frame_samples * BYTES_PER_SAMPLE;
+        int hit = detect_trigger(iq, trig->frame_samples, trig->threshold);
+
+        uint64_t start;
+        if (hit >= 0) {
+            trig->trigger_index = (double) (frame + trig->dropped) *
+                                  trig->frame_samples + hit;
+            trig->post_remaining = trig->post;
+            start = (frame > (uint64_t) trig->pre) ? frame - trig->pre : 0;
+        } else if (trig->post_remaining > 0) {
+            trig->post_remaining--;
+            start = frame;
+        } else
+            continue;
+
+        /* skip unused history, release capture up to current frame */
+        if (start < released) start = released;
+        for (; released < start; released++)
+            trig->valid[released % trig->num_frames] = false;
+        for (; released <= frame; released++) {
+            trig->valid[released % trig->num_frames] = true;
+            trig->trigger[released % trig->num_frames] = trig->trigger_index;
+        }
+    }
+
+    pthread_mutex_lock(&sbuf->mutex);
+    trig->written += trig->frames_per_buffer;
+    if (released != trig->released) {
+        trig->released = released;
+        pthread_cond_signal(&sbuf->cond_var);
+    }
+    pthread_mutex_unlock(&sbuf->mutex);
+}
+
+
 /* ======================================================================== */
 static int hackrf_rx_callback(hackrf_transfer *transfer)
 /* ======================================================================== */
 {
     SimStruct *S = transfer->rx_ctx;
     SampleBuffer *sbuf = ssGetPWorkValue(S, SBUF);
+    TriggerState *trig = ssGetPWorkValue(S, TRIGGER);
 
     if (transfer->valid_length != BUFFER_SIZE) {
         sbuf->error = SB_SIZE_MISSMATCH;
@@ -189,23 +564,137 @@ static int hackrf_rx_callback(hackrf_transfer *transfer)
         return 0;
     }
 
+    if (trig) {
+        trigger_rx(sbuf, trig, transfer->buffer);
+        return 0;
+    }
+
+#ifndef _WIN32
+    /* external readers see the slot as invalid until it is delivered */
+    if (sbuf->shm) hackrf_shm_write_begin(sbuf->shm, sbuf->tail);
+#endif
     memcpy(sbuf->buffers[sbuf->tail], transfer->buffer,
            (size_t) transfer->valid_length);
 
     pthread_mutex_lock(&sbuf->mutex);
-    if (sbuf->ready == NUMBER_OF_BUFFERS) {
+    bool delivered = sbuf->ready < NUMBER_OF_BUFFERS;
+    if (!delivered) {
         sbuf->had_error = true;
         sbuf->error = SB_OVERRUN;
     } else {
+#ifndef _WIN32
+        if (sbuf->shm) hackrf_shm_write_end(sbuf->shm, sbuf->tail);
+#endif
         if (++sbuf->tail >= NUMBER_OF_BUFFERS) sbuf->tail = 0;
         sbuf->ready++;
     }
     pthread_cond_signal(&sbuf->cond_var);
     pthread_mutex_unlock(&sbuf->mutex);
+
+    Agc *agc = ssGetPWorkValue(S, AGC);
+    if (agc) agc_process(agc, transfer->buffer, transfer->valid_length, delivered);
     return 0;
 }
 
 
+/* ======================================================================== */
+static void copy_frame(SimStruct *S, const unsigned char *in, int column)
+/* ======================================================================== */
+{
+    size_t len_out = 2 * (size_t) GetParam(FRAME_SIZE);
+    if (GetParam(USE_DOUBLE)) {
+        real_T *lut = ssGetPWorkValue(S, LUT),
+               *out = ssGetOutputPortRealSignal(S, SAMPLES) + column * len_out;
+        int i=0; for(; i < len_out; i++) out[i] = lut[in[i]];
+    } else
+        memcpy((int8_T*) ssGetOutputPortSignal(S, SAMPLES) + column * len_out,
+               in, len_out);
+}
+
+
+/* ======================================================================== */
+static void clear_frames(SimStruct *S, int column)
+/* ======================================================================== */
+{
+    /* zero the unused columns of the sample matrix */
+    size_t len_out = 2 * (size_t) ssGetOutputPortWidth(S, SAMPLES),
+           start = 2 * (size_t) GetParam(FRAME_SIZE) * column;
+    if (GetParam(USE_DOUBLE)) {
+        real_T *out = ssGetOutputPortRealSignal(S, SAMPLES);
+        size_t i = start; for (; i < len_out; i++) out[i] = 0.0;
+    } else
+        memset((int8_T*) ssGetOutputPortSignal(S, SAMPLES) + start, 0, len_out - start);
+}
+
+
+/* ======================================================================== */
+static void get_deadline(struct timespec *deadline, double timeout)
+/* ======================================================================== */
+{
+    /* absolute system time, as pthread_cond_timedwait expects */
+#ifdef _WIN32
+    struct _timeb now;  /* no clock_gettime with pthreads-win32 */
+    _ftime(&now);
+    deadline->tv_sec = now.time;
+    deadline->tv_nsec = now.millitm * 1000000L;
+#else
+    clock_gettime(CLOCK_REALTIME, deadline);
+#endif
+    double seconds = deadline->tv_nsec * 1e-9 + timeout;
+    deadline->tv_sec += (time_t) seconds;
+    deadline->tv_nsec = (long) ((seconds - floor(seconds)) * 1e9);
+}
+
+
+/* ======================================================================== */
+static void mdlOutputsTriggered(SimStruct *S, SampleBuffer *sbuf,
+                                TriggerState *trig)
+/* ======================================================================== */
+{
+    boolean_T *valid_out = ssGetOutputPortSignal(S, FRAME_VALID);
+    real_T *trigger_out = ssGetOutputPortRealSignal(S, TRIGGER_INDEX);
+
+    struct timespec deadline;
+    get_deadline(&deadline, TRIGGER_IDLE_TIMEOUT);
+
+    pthread_mutex_lock(&sbuf->mutex);
+    for (;;) {
+        /* skip history that was not part of a capture */
+        while (trig->read < trig->released &&
+               !trig->valid[trig->read % trig->num_frames])
+            trig->read++;
+        if (trig->read < trig->released) break;
+
+        Device *device = ssGetPWorkValue(S, DEVICE);
+        if (device_is_streaming(device) != HACKRF_TRUE) {
+            ssSetErrorStatus(S, "Device stopped streaming");
+            pthread_mutex_unlock(&sbuf->mutex);
+            return;
+        }
+        if (pthread_cond_timedwait(&sbuf->cond_var, &sbuf->mutex,
+                                   &deadline) == ETIMEDOUT) {
+            /* no trigger, keep Simulink responsive */
+            pthread_mutex_unlock(&sbuf->mutex);
+            *valid_out = false;
+            return;
+        }
+    }
+    uint64_t frame = trig->read;
+    pthread_mutex_unlock(&sbuf->mutex);
+
+    size_t slot = frame % trig->num_frames;
+    copy_frame(S, sbuf->buffers[slot / trig->frames_per_buffer] +
+                  slot % trig->frames_per_buffer *
+                  trig->frame_samples * BYTES_PER_SAMPLE, 0);
+    *valid_out = true;
+    *trigger_out = trig->trigger[slot];
+
+    pthread_mutex_lock(&sbuf->mutex);
+    trig->read++;
+    pthread_mutex_unlock(&sbuf->mutex);
+}
+
+
 /* ======================================================================== */
 #define MDL_OUTPUTS
 void mdlOutputs(SimStruct *S, int_T tid)
@@ -220,10 +709,16 @@ void mdlOutputs(SimStruct *S, int_T tid)
         sbuf->error = SB_NO_ERROR;
     }
 
+    TriggerState *trig = ssGetPWorkValue(S, TRIGGER);
+    if (trig) {
+        mdlOutputsTriggered(S, sbuf, trig);
+        return;
+    }
+
     pthread_mutex_lock(&sbuf->mutex);
-    if (!sbuf->ready) {
-        hackrf_device *device = ssGetPWorkValue(S, DEVICE);
-        if (hackrf_is_streaming(device) == HACKRF_TRUE) {
+    while (!sbuf->ready) {
+        Device *device = ssGetPWorkValue(S, DEVICE);
+        if (device_is_streaming(device) == HACKRF_TRUE) {
             pthread_cond_wait(&sbuf->cond_var, &sbuf->mutex);
         } else {
             ssSetErrorStatus(S, "Device stopped streaming");
@@ -231,24 +726,51 @@ void mdlOutputs(SimStruct *S, int_T tid)
             return;
         }
     }
+    int ready = sbuf->ready;
     pthread_mutex_unlock(&sbuf->mutex);
 
-    size_t len_out = 2 * (size_t) ssGetOutputPortWidth(S, 0);
-    unsigned char *in = sbuf->buffers[sbuf->head] + sbuf->offset;
-    if (GetParam(USE_DOUBLE)) {
-        real_T *lut = ssGetPWorkValue(S, LUT),
-               *out = ssGetOutputPortRealSignal(S, 0);
-        int i=0; for(; i < len_out; i++) out[i] = lut[in[i]];
-    } else
-        memcpy(ssGetOutputPortSignal(S, 0), in, len_out);
-    sbuf->offset += len_out;
+    size_t frame_bytes = BYTES_PER_SAMPLE * (size_t) GetParam(FRAME_SIZE);
+    int batch = (int) GetOptParam(BATCH_FRAMES, 1), frames = 1;
+    if (batch > 1) {
+        /* drain the backlog, up to one matrix of frames per step */
+        size_t available = (ready * (size_t) BUFFER_SIZE - sbuf->offset) / frame_bytes;
+        if (available < (size_t) batch) frames = (int) available;
+        else frames = batch;
+    }
 
-    if (sbuf->offset >= BUFFER_SIZE) {
-        sbuf->offset = 0;
-        if (++sbuf->head >= NUMBER_OF_BUFFERS) sbuf->head = 0;
-        pthread_mutex_lock(&sbuf->mutex);
-        sbuf->ready--;
-        pthread_mutex_unlock(&sbuf->mutex);
+    Channelizer *ch = ssGetPWorkValue(S, CHANNELIZER);
+    int k = 0; for (; k < frames; k++) {
+        unsigned char *in = sbuf->buffers[sbuf->head] + sbuf->offset;
+        if (ch) {
+            int i = 0; for (; i < ch->num_outputs; i++)
+                ch->outputs[i] = ssGetOutputPortRealSignal(S, i);
+            channelizer_process(ch, (const signed char*) in);
+        } else
+            copy_frame(S, in, k);
+        sbuf->offset += frame_bytes;
+
+        if (sbuf->offset >= BUFFER_SIZE) {
+            sbuf->offset = 0;
+            if (++sbuf->head >= NUMBER_OF_BUFFERS) sbuf->head = 0;
+            pthread_mutex_lock(&sbuf->mutex);
+            sbuf->ready--;
+            pthread_mutex_unlock(&sbuf->mutex);
+        }
+    }
+    if (batch > 1) {
+        clear_frames(S, frames);
+        *ssGetOutputPortRealSignal(S, BATCH_COUNT) = frames;
+    }
+
+    Agc *agc = ssGetPWorkValue(S, AGC);
+    if (agc) {
+        int port = ssGetNumOutputPorts(S) - AGC_PORTS;
+        agc->output_index += frames * GetParam(FRAME_SIZE);
+        agc_next_change(agc, agc->output_index, &agc->current);
+        real_T *gain = ssGetOutputPortRealSignal(S, port);
+        gain[0] = agc->current.lna_gain;
+        gain[1] = agc->current.vga_gain;
+        *ssGetOutputPortRealSignal(S, port + 1) = agc->current.sample_index;
     }
 }
 
@@ -262,6 +784,8 @@ void mdlSimStatusChange(SimStruct *S, ssSimStatusChangeType simStatus)
     if (simStatus == SIM_PAUSE) {
         SampleBuffer *sbuf = ssGetPWorkValue(S, SBUF);
         if (sbuf->had_error) ssPrintf("\n");
+        Agc *agc = ssGetPWorkValue(S, AGC);
+        if (agc) agc_stop(agc);
         stopHackRf(S, DEVICE);
 
     } else if (simStatus == SIM_CONTINUE)
@@ -274,6 +798,11 @@ void mdlSimStatusChange(SimStruct *S, ssSimStatusChangeType simStatus)
 void mdlTerminate(SimStruct *S)
 /* ======================================================================== */
 {
+    Agc *agc = ssGetPWorkValue(S, AGC);
+    if (agc) {
+        agc_free(agc);  /* stops the control thread before the device */
+        ssSetPWorkValue(S, AGC, NULL);
+    }
     stopHackRf(S, DEVICE);
     Hackrf_assert(S, hackrf_exit(), "Failed to exit HackRF API");
 
@@ -288,6 +817,16 @@ void mdlTerminate(SimStruct *S)
         free(lut);
         ssSetPWorkValue(S, LUT, NULL);
     }
+    TriggerState *trig = ssGetPWorkValue(S, TRIGGER);
+    if (trig) {
+        trigger_state_free(trig);
+        ssSetPWorkValue(S, TRIGGER, NULL);
+    }
+    Channelizer *ch = ssGetPWorkValue(S, CHANNELIZER);
+    if (ch) {
+        channelizer_free(ch);
+        ssSetPWorkValue(S, CHANNELIZER, NULL);
+    }
 }
 
 #ifdef  MATLAB_MEX_FILE    /* Is this file being compiled as a MEX-file? */
@@ -0,0 +1,474 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+/* Serves a HackRF (or the mock device) to one Simulink-HackRF client at a
+   time over TCP, see remote_protocol.h. POSIX only.
+
+   usage: hackrf_tcp_server [-a address] [-p port] [--mock]
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "pthread.h"
+#include "device.h"
+#include "remote_protocol.h"
+
+
+#define QUEUE_SIZE     32          /* transfers buffered, about 0.2 s at 20 MSps */
+#define POLL_INTERVAL  500         /* ms between checks of the device */
+#define SOCKET_BUFFER  (4 << 20)
+
+
+typedef struct {
+    remote_socket sock;
+    const char *address;            /* of the device, see device_open */
+    Device *device;
+    pthread_mutex_t send_mutex;
+
+    /* transfers from the device (RX) or to it (TX), one direction at a time */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *slots[QUEUE_SIZE], *scratch;
+    uint32_t lengths[QUEUE_SIZE];
+    uint64_t indices[QUEUE_SIZE];
+    int head, count;
+
+    volatile bool rx, tx;
+    bool packed, quit;
+    uint64_t sample_index;          /* next RX sample of the device */
+    unsigned long transfers, dropped, underruns;
+    pthread_t sender;
+} Session;
+
+
+/* ======================================================================== */
+
+
+static bool writev_all(remote_socket sock, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t sent = writev(sock, iov, count);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        for (; count > 0 && (size_t) sent >= iov->iov_len; iov++, count--)
+            sent -= (ssize_t) iov->iov_len;
+        if (count > 0) {
+            iov->iov_base = (uint8_t*) iov->iov_base + sent;
+            iov->iov_len -= (size_t) sent;
+        }
+    }
+    return true;
+}
+
+static bool send_message(Session *s, enum RemoteMessageType type, int status,
+                         const char *payload)
+{
+    RemoteHeader header = {type, 0, status, payload ? (uint32_t) strlen(payload) + 1 : 0, 0};
+    uint8_t buf[REMOTE_HEADER_SIZE];
+    remote_header_pack(&header, buf);
+    pthread_mutex_lock(&s->send_mutex);
+    bool ok = remote_send_all(s->sock, buf, sizeof(buf)) &&
+              (!payload || remote_send_all(s->sock, payload, header.length));
+    pthread_mutex_unlock(&s->send_mutex);
+    return ok;
+}
+
+
+/* ======================================================================== */
+
+
+static int rx_callback(hackrf_transfer *transfer)
+{
+    Session *s = transfer->rx_ctx;
+    uint64_t index = s->sample_index;
+    s->sample_index += (uint64_t) transfer->valid_length / 2;
+    if (transfer->valid_length > DEVICE_TRANSFER_SIZE) return 0;
+
+    pthread_mutex_lock(&s->mutex);
+    bool full = s->count == QUEUE_SIZE;
+    int slot = (s->head + s->count) % QUEUE_SIZE;
+    if (full) s->dropped++;  /* the client sees a gap in the sample index */
+    pthread_mutex_unlock(&s->mutex);
+    if (full) return 0;
+
+    memcpy(s->slots[slot], transfer->buffer, (size_t) transfer->valid_length);
+    s->lengths[slot] = (uint32_t) transfer->valid_length;
+    s->indices[slot] = index;
+
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    s->transfers++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+
+/* sends all queued RX transfers in one write */
+static void *sender_thread(void *arg)
+{
+    Session *s = arg;
+    uint8_t headers[QUEUE_SIZE][REMOTE_HEADER_SIZE];
+    struct iovec iov[2 * QUEUE_SIZE];
+
+    pthread_mutex_lock(&s->mutex);
+    while (!s->quit) {
+        if (!s->rx || !s->count) {
+            pthread_cond_wait(&s->cond, &s->mutex);
+            continue;
+        }
+        int first = s->head, n = s->count, k = 0;
+        pthread_mutex_unlock(&s->mutex);
+
+        for (; k < n; k++) {
+            int slot = (first + k) % QUEUE_SIZE;
+            RemoteHeader header = {REMOTE_RX_DATA, 0, 0, s->lengths[slot], s->indices[slot]};
+            if (s->packed) {
+                header.flags = REMOTE_FLAG_PACKED;
+                header.length = (uint32_t) remote_pack4(s->slots[slot], header.length);
+            }
+            remote_header_pack(&header, headers[k]);
+            iov[2 * k].iov_base = headers[k];
+            iov[2 * k].iov_len = REMOTE_HEADER_SIZE;
+            iov[2 * k + 1].iov_base = s->slots[slot];
+            iov[2 * k + 1].iov_len = header.length;
+        }
+        pthread_mutex_lock(&s->send_mutex);
+        writev_all(s->sock, iov, 2 * n);  /* errors show up in the receive loop */
+        pthread_mutex_unlock(&s->send_mutex);
+
+        pthread_mutex_lock(&s->mutex);
+        s->head = (first + n) % QUEUE_SIZE;
+        s->count -= n;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+
+/* ======================================================================== */
+
+
+static int tx_callback(hackrf_transfer *transfer)
+{
+    Session *s = transfer->tx_ctx;
+    size_t length = (size_t) transfer->valid_length;
+
+    pthread_mutex_lock(&s->mutex);
+    bool empty = !s->count;
+    int slot = s->head;
+    if (empty) s->underruns++;
+    pthread_mutex_unlock(&s->mutex);
+    if (empty) {
+        memset(transfer->buffer, 0, length);
+        return 0;
+    }
+
+    size_t copy = s->lengths[slot] < length ? s->lengths[slot] : length;
+    memcpy(transfer->buffer, s->slots[slot], copy);
+    memset(transfer->buffer + copy, 0, length - copy);
+
+    pthread_mutex_lock(&s->mutex);
+    s->head = (s->head + 1) % QUEUE_SIZE;
+    s->count--;
+    s->transfers++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+
+static void session_check(Session *s);
+
+static bool receive_tx(Session *s, const RemoteHeader *header)
+{
+    bool packed = header->flags & REMOTE_FLAG_PACKED;
+    size_t length = header->length, unpacked = packed ? 2 * length : length;
+    if (unpacked > DEVICE_TRANSFER_SIZE) return remote_skip(s->sock, length);
+
+    /* backpressure: the socket is not read until the device took a transfer */
+    pthread_mutex_lock(&s->mutex);
+    while (s->tx && s->count == QUEUE_SIZE) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += POLL_INTERVAL * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&s->cond, &s->mutex, &deadline) == ETIMEDOUT &&
+            device_is_streaming(s->device) != HACKRF_TRUE)
+            break;
+    }
+    bool accept = s->tx && s->count < QUEUE_SIZE;
+    int slot = (s->head + s->count) % QUEUE_SIZE;
+    pthread_mutex_unlock(&s->mutex);
+    if (!accept) {
+        bool ok = remote_skip(s->sock, length);
+        /* the client keeps the socket busy, so poll never times out to
+           notice a device that stopped on its own */
+        session_check(s);
+        return ok;
+    }
+
+    if (packed) {
+        if (!remote_recv_all(s->sock, s->scratch, length)) return false;
+        remote_unpack4(s->scratch, length, s->slots[slot]);
+    } else if (!remote_recv_all(s->sock, s->slots[slot], length))
+        return false;
+    s->lengths[slot] = (uint32_t) unpacked;
+
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    pthread_mutex_unlock(&s->mutex);
+    return true;
+}
+
+
+/* ======================================================================== */
+
+
+static int session_stop(Session *s)
+{
+    if (!s->rx && !s->tx) return HACKRF_SUCCESS;
+    int ret = device_stop(s->device);
+
+    pthread_mutex_lock(&s->mutex);
+    while (s->rx && s->count && !s->quit)  /* data goes out before the reply */
+        pthread_cond_wait(&s->cond, &s->mutex);
+    fprintf(stderr, s->rx ? "RX stopped: %lu transfers, %lu dropped\n" :
+                            "TX stopped: %lu transfers, %lu underruns\n",
+            s->transfers, s->rx ? s->dropped : s->underruns);
+    s->rx = s->tx = false;
+    s->head = s->count = 0;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return ret;
+}
+
+
+static int session_start(Session *s, bool tx, uint16_t flags)
+{
+    session_stop(s);
+    s->packed = flags & REMOTE_FLAG_PACKED;
+    s->sample_index = 0;
+    s->transfers = s->dropped = s->underruns = 0;
+    if (tx) s->tx = true;
+    else s->rx = true;
+
+    int ret = tx ? device_start_tx(s->device, tx_callback, s) :
+                   device_start_rx(s->device, rx_callback, s);
+    if (ret != HACKRF_SUCCESS) s->rx = s->tx = false;
+    else fprintf(stderr, "%s started%s\n", tx ? "TX" : "RX", s->packed ? " (4 bit)" : "");
+    return ret;
+}
+
+
+static void session_check(Session *s)
+{
+    /* tell the client if the device stopped on its own, e.g. USB errors */
+    if (!s->rx && !s->tx) return;
+    int ret = device_is_streaming(s->device);
+    if (ret == HACKRF_TRUE) return;
+    fprintf(stderr, "Device stopped streaming (%d)\n", ret);
+    session_stop(s);
+    send_message(s, REMOTE_STREAM_END, ret, NULL);
+}
+
+
+static void session_run(Session *s)
+{
+    uint8_t buf[REMOTE_HEADER_SIZE];
+    RemoteHeader header;
+    char info[256];
+
+    for (;;) {
+        struct pollfd pfd = {s->sock, POLLIN, 0};
+        int ready = poll(&pfd, 1, POLL_INTERVAL);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) {
+            if (s->device) session_check(s);
+            continue;
+        }
+        if (!remote_recv_all(s->sock, buf, sizeof(buf)) ||
+            !remote_header_unpack(buf, &header))
+            break;
+
+        if (header.type == REMOTE_TX_DATA) {
+            if (!receive_tx(s, &header)) break;
+            continue;
+        }
+        if (!remote_skip(s->sock, header.length)) break;
+        if (header.type != REMOTE_HELLO && !s->device) {
+            send_message(s, REMOTE_REPLY, HACKRF_ERROR_INVALID_PARAM, NULL);
+            continue;
+        }
+
+        int ret = HACKRF_ERROR_INVALID_PARAM;
+        switch (header.type) {
+            case REMOTE_HELLO:
+                if (header.value != REMOTE_VERSION || s->device) break;
+                ret = device_open(s->address, &s->device);
+                if (ret == HACKRF_SUCCESS) ret = device_info(s->device, info, sizeof(info));
+                if (ret == HACKRF_SUCCESS) fprintf(stderr, "Using %s\n", info);
+                break;
+            case REMOTE_SET:
+                ret = device_set(s->device, (enum DeviceParam) header.flags,
+                                 remote_to_double(header.value));
+                break;
+            case REMOTE_START_RX:
+            case REMOTE_START_TX:
+                ret = session_start(s, header.type == REMOTE_START_TX, header.flags);
+                break;
+            case REMOTE_STOP:
+                ret = session_stop(s);
+                break;
+            default:
+                break;
+        }
+        bool hello = header.type == REMOTE_HELLO && ret == HACKRF_SUCCESS;
+        if (!send_message(s, REMOTE_REPLY, ret, hello ? info : NULL)) break;
+        if (header.type == REMOTE_HELLO && ret != HACKRF_SUCCESS) break;
+    }
+}
+
+
+static void serve_client(remote_socket sock, const char *address)
+{
+    Session *s = calloc(1, sizeof(Session));
+    s->sock = sock;
+    s->address = address;
+    int i = 0; for (; i < QUEUE_SIZE; i++) s->slots[i] = malloc(DEVICE_TRANSFER_SIZE);
+    s->scratch = malloc(DEVICE_TRANSFER_SIZE);
+    pthread_mutex_init(&s->send_mutex, NULL);
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    int one = 1, size = SOCKET_BUFFER;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    pthread_create(&s->sender, NULL, sender_thread, s);
+
+    session_run(s);
+
+    if (s->device) session_stop(s);
+    pthread_mutex_lock(&s->mutex);
+    s->quit = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    pthread_join(s->sender, NULL);
+    if (s->device) device_close(s->device);
+    close(sock);
+
+    for (i = 0; i < QUEUE_SIZE; i++) free(s->slots[i]);
+    free(s->scratch);
+    pthread_mutex_destroy(&s->send_mutex);
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+
+/* ======================================================================== */
+
+
+static remote_socket listen_on(const char *address, const char *port)
+{
+    struct addrinfo hints, *result, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int ret = getaddrinfo(address, port, &hints, &result);
+    if (ret) {
+        fprintf(stderr, "Invalid address: %s\n", gai_strerror(ret));
+        return REMOTE_INVALID_SOCKET;
+    }
+
+    remote_socket sock = REMOTE_INVALID_SOCKET;
+    for (ai = result; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == REMOTE_INVALID_SOCKET) continue;
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (!bind(sock, ai->ai_addr, ai->ai_addrlen) && !listen(sock, 1)) break;
+        close(sock);
+        sock = REMOTE_INVALID_SOCKET;
+    }
+    freeaddrinfo(result);
+    if (sock == REMOTE_INVALID_SOCKET) perror("Failed to listen");
+    return sock;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *address = NULL, *port = REMOTE_DEFAULT_PORT, *device = "";
+    int i = 1; for (; i < argc; i++) {
+        if (!strcmp(argv[i], "-a") && i + 1 < argc) address = argv[++i];
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc) port = argv[++i];
+        else if (!strcmp(argv[i], "--mock")) device = "mock";
+        else {
+            fprintf(stderr, "usage: %s [-a address] [-p port] [--mock]\n"
+                    "  -a address  listen on this address only\n"
+                    "  -p port     TCP port (default %s)\n"
+                    "  --mock      serve a synthetic device\n",
+                    argv[0], REMOTE_DEFAULT_PORT);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int ret = hackrf_init();
+    if (ret != HACKRF_SUCCESS) {
+        fprintf(stderr, "Failed to initialize HackRF API (%d)\n", ret);
+        return 1;
+    }
+    remote_socket server = listen_on(address, port);
+    if (server == REMOTE_INVALID_SOCKET) return 1;
+    fprintf(stderr, "Serving %s on port %s\n", device[0] ? "mock device" : "HackRF", port);
+
+    for (;;) {
+        struct sockaddr_storage peer;
+        socklen_t peer_length = sizeof(peer);
+        remote_socket sock = accept(server, (struct sockaddr*) &peer, &peer_length);
+        if (sock == REMOTE_INVALID_SOCKET) {
+            if (errno == EINTR) continue;
+            perror("Failed to accept");
+            break;
+        }
+        char host[NI_MAXHOST] = "?";
+        getnameinfo((struct sockaddr*) &peer, peer_length, host, sizeof(host),
+                    NULL, 0, NI_NUMERICHOST);
+        fprintf(stderr, "Client %s connected\n", host);
+        serve_client(sock, device);
+        fprintf(stderr, "Client %s disconnected\n", host);
+    }
+
+    close(server);
+    hackrf_exit();
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "pthread.h"
+#include "mock.h"
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TONE_PERIOD     64     /* samples */
+#define REFERENCE_GAIN  50.0   /* dB total gain for a tone at 1/4 full scale */
+#define AMP_GAIN        14.0   /* dB */
+
+
+struct MockDevice {
+    double params[NUM_DEVICE_PARAMS];
+
+    pthread_t thread;
+    bool tx, thread_running;
+    volatile bool streaming, quit;
+    hackrf_sample_block_cb_fn callback;
+    void *ctx;
+
+    uint8_t *buffer;
+    unsigned phase;                 /* of the tone, in samples */
+    uint32_t noise;                 /* LCG state */
+};
+
+
+/* ======================================================================== */
+
+
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double) count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void sleep_until(double t)
+{
+    double seconds = t - now();
+    if (seconds <= 0) return;
+#ifdef _WIN32
+    Sleep((DWORD) (seconds * 1e3));
+#else
+    usleep((useconds_t) (seconds * 1e6));
+#endif
+}
+
+static int clamp(int value)
+{
+    return (value > 127) ? 127 : (value < -127) ? -127 : value;
+}
+
+
+static void mock_fill(MockDevice *mock)
+{
+    double gain = mock->params[DEVICE_LNA_GAIN] + mock->params[DEVICE_VGA_GAIN] +
+                  AMP_GAIN * (mock->params[DEVICE_AMP_ENABLE] != 0);
+    double amplitude = 32.0 * pow(10.0, (gain - REFERENCE_GAIN) / 20);
+    int tone[2 * TONE_PERIOD], k = 0;
+    for (; k < TONE_PERIOD; k++) {
+        tone[2 * k] = clamp((int) lrint(amplitude * cos(2 * M_PI * k / TONE_PERIOD)));
+        tone[2 * k + 1] = clamp((int) lrint(amplitude * sin(2 * M_PI * k / TONE_PERIOD)));
+    }
+
+    int8_t *iq = (int8_t*) mock->buffer;
+    int i = 0; for (; i < DEVICE_TRANSFER_SIZE / 2; i++) {
+        mock->noise = mock->noise * 1664525u + 1013904223u;
+        int n_re = (int) (mock->noise >> 31) - (int) ((mock->noise >> 30) & 1),
+            n_im = (int) ((mock->noise >> 29) & 1) - (int) ((mock->noise >> 28) & 1);
+        k = (int) (mock->phase++ % TONE_PERIOD);
+        iq[2 * i] = (int8_t) clamp(tone[2 * k] + n_re);
+        iq[2 * i + 1] = (int8_t) clamp(tone[2 * k + 1] + n_im);
+    }
+}
+
+
+static void *mock_thread(void *arg)
+{
+    MockDevice *mock = arg;
+    double t = now();
+    while (!mock->quit) {
+        if (!mock->tx) mock_fill(mock);
+        hackrf_transfer transfer = {
+            NULL, mock->buffer, DEVICE_TRANSFER_SIZE, DEVICE_TRANSFER_SIZE,
+            mock->tx ? NULL : mock->ctx, mock->tx ? mock->ctx : NULL
+        };
+        if (mock->callback(&transfer)) break;
+
+        /* pace at the sample rate, catch up at most 1 s */
+        t += DEVICE_TRANSFER_SIZE / 2 / mock->params[DEVICE_SAMPLE_RATE];
+        if (now() - t > 1.0) t = now();
+        sleep_until(t);
+    }
+    mock->streaming = false;
+    return NULL;
+}
+
+
+/* ======================================================================== */
+
+
+int mock_open(MockDevice **mock_out)
+{
+    MockDevice *mock = calloc(1, sizeof(MockDevice));
+    mock->params[DEVICE_SAMPLE_RATE] = 10e6;
+    mock->buffer = calloc(DEVICE_TRANSFER_SIZE, 1);
+    mock->noise = 1;
+    *mock_out = mock;
+    return HACKRF_SUCCESS;
+}
+
+
+int mock_close(MockDevice *mock)
+{
+    mock_stop(mock);
+    free(mock->buffer);
+    free(mock);
+    return HACKRF_SUCCESS;
+}
+
+
+const char *mock_info(MockDevice *mock)
+{
+    (void) mock;
+    return "mock device";
+}
+
+
+int mock_set(MockDevice *mock, enum DeviceParam param, double value)
+{
+    if (param < 0 || param >= NUM_DEVICE_PARAMS) return HACKRF_ERROR_INVALID_PARAM;
+    if (param == DEVICE_SAMPLE_RATE && !(value > 0)) return HACKRF_ERROR_INVALID_PARAM;
+    mock->params[param] = value;
+    return HACKRF_SUCCESS;
+}
+
+
+int mock_start(MockDevice *mock, bool tx, hackrf_sample_block_cb_fn callback, void *ctx)
+{
+    mock_stop(mock);
+    mock->tx = tx;
+    mock->callback = callback;
+    mock->ctx = ctx;
+    mock->quit = false;
+    mock->streaming = true;
+    mock->thread_running = true;
+    pthread_create(&mock->thread, NULL, mock_thread, mock);
+    return HACKRF_SUCCESS;
+}
+
+
+int mock_stop(MockDevice *mock)
+{
+    if (!mock->thread_running) return HACKRF_SUCCESS;
+    mock->quit = true;
+    pthread_join(mock->thread, NULL);
+    mock->thread_running = false;
+    mock->streaming = false;
+    return HACKRF_SUCCESS;
+}
+
+
+int mock_is_streaming(MockDevice *mock)
+{
+    return mock->streaming ? HACKRF_TRUE : HACKRF_ERROR_OTHER;
+}
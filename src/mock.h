@@ -0,0 +1,44 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_MOCK_H
+#define HACKRF_MOCK_H
+
+#include "device.h"
+
+
+/* ======================================================================== */
+
+
+/* Synthetic device: a thread calls the callback at the set sample rate.
+   RX transfers hold a tone at 1/64 of the sample rate with a little noise,
+   its level follows the amp, LNA and VGA settings. TX transfers are
+   fetched and discarded. */
+
+int mock_open(MockDevice **mock);
+int mock_close(MockDevice *mock);
+const char *mock_info(MockDevice *mock);
+
+int mock_set(MockDevice *mock, enum DeviceParam param, double value);
+
+int mock_start(MockDevice *mock, bool tx, hackrf_sample_block_cb_fn callback, void *ctx);
+int mock_stop(MockDevice *mock);
+int mock_is_streaming(MockDevice *mock);
+
+#endif /* HACKRF_MOCK_H */
@@ -0,0 +1,390 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/timeb.h>
+#endif
+
+#include "pthread.h"
+#include "remote.h"
+#include "remote_protocol.h"
+
+
+#define REQUEST_TIMEOUT 5  /* s until a request without reply fails */
+#define SOCKET_BUFFER   (4 << 20)
+
+
+struct RemoteDevice {
+    remote_socket sock;
+    char info[256];
+    bool packed;
+
+    pthread_t thread;               /* receives replies and RX data */
+    pthread_t tx_thread;            /* sends TX data */
+    bool tx_thread_running;
+    pthread_mutex_t mutex, send_mutex, request_mutex;
+    pthread_cond_t cond;
+
+    /* reply to the pending request */
+    bool reply_ready;
+    int reply_status;
+
+    volatile bool connected, rx_streaming, tx_streaming;
+    hackrf_sample_block_cb_fn callback;
+    void *ctx;
+    uint64_t next_index;            /* expected index of the next RX sample */
+    unsigned long lost;
+
+    uint8_t *buffer, *packed_buffer;
+};
+
+
+/* ======================================================================== */
+
+
+static bool remote_send(RemoteDevice *remote, const RemoteHeader *header,
+                        const uint8_t *payload)
+{
+    uint8_t buf[REMOTE_HEADER_SIZE];
+    remote_header_pack(header, buf);
+    pthread_mutex_lock(&remote->send_mutex);
+    bool ok = remote_send_all(remote->sock, buf, sizeof(buf)) &&
+              (!header->length || remote_send_all(remote->sock, payload, header->length));
+    pthread_mutex_unlock(&remote->send_mutex);
+    return ok;
+}
+
+
+static int remote_request(RemoteDevice *remote, enum RemoteMessageType type,
+                          uint16_t flags, uint64_t value)
+{
+    RemoteHeader header = {type, flags, 0, 0, value};
+    pthread_mutex_lock(&remote->request_mutex);  /* one request at a time */
+    pthread_mutex_lock(&remote->mutex);
+    remote->reply_ready = false;
+    pthread_mutex_unlock(&remote->mutex);
+
+    int ret = HACKRF_ERROR_OTHER;
+    if (remote->connected && remote_send(remote, &header, NULL)) {
+        struct timespec deadline;  /* absolute system time */
+#ifdef _WIN32
+        struct _timeb now;  /* no clock_gettime with pthreads-win32 */
+        _ftime(&now);
+        deadline.tv_sec = now.time;
+        deadline.tv_nsec = now.millitm * 1000000L;
+#else
+        clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+        deadline.tv_sec += REQUEST_TIMEOUT;
+        pthread_mutex_lock(&remote->mutex);
+        while (!remote->reply_ready && remote->connected)
+            if (pthread_cond_timedwait(&remote->cond, &remote->mutex, &deadline) == ETIMEDOUT)
+                break;
+        if (remote->reply_ready) ret = remote->reply_status;
+        pthread_mutex_unlock(&remote->mutex);
+    }
+    pthread_mutex_unlock(&remote->request_mutex);
+    return ret;
+}
+
+
+/* ======================================================================== */
+
+
+static void remote_rx_data(RemoteDevice *remote, const RemoteHeader *header)
+{
+    bool packed = (header->flags & REMOTE_FLAG_PACKED) != 0;
+    size_t length = packed ? 2 * (size_t) header->length : header->length;
+    if (!remote->rx_streaming || length > DEVICE_TRANSFER_SIZE) return;
+    if (packed)
+        remote_unpack4(remote->packed_buffer, header->length, remote->buffer);
+
+    if (header->value > remote->next_index)  /* dropped by the server */
+        remote->lost += (unsigned long) ((header->value - remote->next_index) /
+                                         (DEVICE_TRANSFER_SIZE / 2));
+    remote->next_index = header->value + length / 2;
+
+    hackrf_transfer transfer = {
+        NULL, remote->buffer, (int) length, (int) length, remote->ctx, NULL
+    };
+    if (remote->callback(&transfer))
+        remote->rx_streaming = false;  /* like libhackrf, stop on request */
+}
+
+
+static void *remote_thread(void *arg)
+{
+    RemoteDevice *remote = arg;
+    uint8_t buf[REMOTE_HEADER_SIZE];
+    RemoteHeader header;
+
+    while (remote_recv_all(remote->sock, buf, sizeof(buf)) &&
+           remote_header_unpack(buf, &header)) {
+        if (header.type == REMOTE_RX_DATA) {
+            bool packed = (header.flags & REMOTE_FLAG_PACKED) != 0;
+            uint8_t *payload = packed ? remote->packed_buffer : remote->buffer;
+            /* packed payloads unpack to twice their size */
+            if (header.length > (packed ? DEVICE_TRANSFER_SIZE / 2 : DEVICE_TRANSFER_SIZE)) {
+                if (!remote_skip(remote->sock, header.length)) break;
+                continue;
+            }
+            if (!remote_recv_all(remote->sock, payload, header.length)) break;
+            remote_rx_data(remote, &header);
+
+        } else if (header.type == REMOTE_REPLY) {
+            char info[sizeof(remote->info)] = "";
+            size_t length = header.length < sizeof(info) - 1 ? header.length : sizeof(info) - 1;
+            if (!remote_recv_all(remote->sock, info, length) ||
+                !remote_skip(remote->sock, header.length - length)) break;
+            pthread_mutex_lock(&remote->mutex);
+            if (length) memcpy(remote->info, info, length + 1);
+            remote->reply_status = header.status;
+            remote->reply_ready = true;
+            pthread_cond_broadcast(&remote->cond);
+            pthread_mutex_unlock(&remote->mutex);
+
+        } else {
+            if (header.type == REMOTE_STREAM_END)
+                remote->rx_streaming = remote->tx_streaming = false;
+            if (!remote_skip(remote->sock, header.length)) break;
+        }
+    }
+
+    pthread_mutex_lock(&remote->mutex);
+    remote->connected = false;
+    remote->rx_streaming = remote->tx_streaming = false;
+    pthread_cond_broadcast(&remote->cond);
+    pthread_mutex_unlock(&remote->mutex);
+    return NULL;
+}
+
+
+static void *remote_tx_thread(void *arg)
+{
+    RemoteDevice *remote = arg;
+    while (remote->tx_streaming && remote->connected) {
+        hackrf_transfer transfer = {
+            NULL, remote->buffer, DEVICE_TRANSFER_SIZE, DEVICE_TRANSFER_SIZE,
+            NULL, remote->ctx
+        };
+        if (remote->callback(&transfer)) {
+            remote->tx_streaming = false;
+            break;
+        }
+        RemoteHeader header = {REMOTE_TX_DATA, 0, 0, DEVICE_TRANSFER_SIZE, 0};
+        if (remote->packed) {
+            header.flags = REMOTE_FLAG_PACKED;
+            header.length = (uint32_t) remote_pack4(remote->buffer, DEVICE_TRANSFER_SIZE);
+        }
+        /* blocks while the server's queue is full */
+        if (!remote_send(remote, &header, remote->buffer)) break;
+    }
+    return NULL;
+}
+
+
+/* ======================================================================== */
+
+
+static remote_socket remote_connect(const char *host, const char *port)
+{
+    struct addrinfo hints, *result, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result)) return REMOTE_INVALID_SOCKET;
+
+    remote_socket sock = REMOTE_INVALID_SOCKET;
+    for (ai = result; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == REMOTE_INVALID_SOCKET) continue;
+        if (!connect(sock, ai->ai_addr, (int) ai->ai_addrlen)) break;
+        remote_close_socket(sock);
+        sock = REMOTE_INVALID_SOCKET;
+    }
+    freeaddrinfo(result);
+    if (sock == REMOTE_INVALID_SOCKET) return sock;
+
+    /* control requests must not wait for more data, RX needs headroom */
+    int one = 1, size = SOCKET_BUFFER;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*) &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*) &size, sizeof(size));
+#ifdef SO_NOSIGPIPE
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return sock;
+}
+
+
+int remote_open(const char *address, RemoteDevice **remote_out)
+{
+    *remote_out = NULL;
+    /* host[:port][,4bit], IPv6 hosts in brackets */
+    char host[256], port[16] = REMOTE_DEFAULT_PORT;
+    snprintf(host, sizeof(host), "%s", address);
+    char *options = strchr(host, ',');
+    if (options) *options++ = '\0';
+    char *colon = strrchr(host, ':');
+    if (colon && (host[0] != '[' || colon > strchr(host, ']'))) {
+        *colon = '\0';
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+    if (host[0] == '[') {
+        memmove(host, host + 1, strlen(host));
+        char *bracket = strchr(host, ']');
+        if (bracket) *bracket = '\0';
+    }
+    if (options && strcmp(options, "4bit")) return HACKRF_ERROR_INVALID_PARAM;
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data)) return HACKRF_ERROR_OTHER;
+#endif
+    remote_socket sock = remote_connect(host, port);
+    if (sock == REMOTE_INVALID_SOCKET) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return HACKRF_ERROR_NOT_FOUND;
+    }
+
+    RemoteDevice *remote = calloc(1, sizeof(RemoteDevice));
+    remote->sock = sock;
+    remote->packed = options != NULL;
+    remote->connected = true;
+    remote->buffer = malloc(DEVICE_TRANSFER_SIZE);
+    remote->packed_buffer = malloc(DEVICE_TRANSFER_SIZE);
+    pthread_mutex_init(&remote->mutex, NULL);
+    pthread_mutex_init(&remote->send_mutex, NULL);
+    pthread_mutex_init(&remote->request_mutex, NULL);
+    pthread_cond_init(&remote->cond, NULL);
+    pthread_create(&remote->thread, NULL, remote_thread, remote);
+
+    int ret = remote_request(remote, REMOTE_HELLO, 0, REMOTE_VERSION);
+    if (ret != HACKRF_SUCCESS) {
+        remote_close(remote);
+        return ret;
+    }
+    size_t length = strlen(remote->info);
+    snprintf(remote->info + length, sizeof(remote->info) - length, " at %s", address);
+    *remote_out = remote;
+    return HACKRF_SUCCESS;
+}
+
+
+int remote_close(RemoteDevice *remote)
+{
+    if (remote->rx_streaming || remote->tx_streaming) remote_stop(remote);
+    /* wakes up the receive thread, the server closes its side */
+#ifdef _WIN32
+    shutdown(remote->sock, SD_BOTH);
+#else
+    shutdown(remote->sock, SHUT_RDWR);
+#endif
+    pthread_join(remote->thread, NULL);
+    if (remote->tx_thread_running) pthread_join(remote->tx_thread, NULL);
+    remote_close_socket(remote->sock);
+
+    pthread_mutex_destroy(&remote->mutex);
+    pthread_mutex_destroy(&remote->send_mutex);
+    pthread_mutex_destroy(&remote->request_mutex);
+    pthread_cond_destroy(&remote->cond);
+    free(remote->buffer);
+    free(remote->packed_buffer);
+    free(remote);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return HACKRF_SUCCESS;
+}
+
+
+const char *remote_info(RemoteDevice *remote)
+{
+    return remote->info;
+}
+
+
+/* ======================================================================== */
+
+
+int remote_set(RemoteDevice *remote, enum DeviceParam param, double value)
+{
+    return remote_request(remote, REMOTE_SET, (uint16_t) param, remote_from_double(value));
+}
+
+
+int remote_start(RemoteDevice *remote, bool tx,
+                 hackrf_sample_block_cb_fn callback, void *ctx)
+{
+    if (remote->tx_thread_running) {  /* left over from a stopped TX stream */
+        pthread_join(remote->tx_thread, NULL);
+        remote->tx_thread_running = false;
+    }
+    remote->callback = callback;
+    remote->ctx = ctx;
+    remote->next_index = 0;
+    remote->lost = 0;
+    remote->rx_streaming = !tx;  /* data may arrive before the reply */
+
+    int ret = remote_request(remote, tx ? REMOTE_START_TX : REMOTE_START_RX,
+                             remote->packed ? REMOTE_FLAG_PACKED : 0, 0);
+    if (ret != HACKRF_SUCCESS) {
+        remote->rx_streaming = false;
+        return ret;
+    }
+    if (tx) {
+        remote->tx_streaming = true;
+        remote->tx_thread_running = true;
+        pthread_create(&remote->tx_thread, NULL, remote_tx_thread, remote);
+    }
+    return HACKRF_SUCCESS;
+}
+
+
+int remote_stop(RemoteDevice *remote)
+{
+    /* let the TX thread finish its transfer, then stop the device */
+    remote->tx_streaming = false;
+    if (remote->tx_thread_running) {
+        pthread_join(remote->tx_thread, NULL);
+        remote->tx_thread_running = false;
+    }
+    int ret = remote_request(remote, REMOTE_STOP, 0, 0);
+    remote->rx_streaming = false;
+    return ret;
+}
+
+
+int remote_is_streaming(RemoteDevice *remote)
+{
+    return (remote->connected && (remote->rx_streaming || remote->tx_streaming)) ?
+           HACKRF_TRUE : HACKRF_ERROR_OTHER;
+}
+
+
+unsigned long remote_lost(RemoteDevice *remote)
+{
+    return remote->lost;
+}
@@ -0,0 +1,46 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+#ifndef HACKRF_REMOTE_H
+#define HACKRF_REMOTE_H
+
+#include "device.h"
+
+
+/* ======================================================================== */
+
+
+/* Client of hackrf_tcp_server. A receive thread handles replies and RX
+   transfers, which are passed to the callback like libhackrf does. In TX
+   mode a second thread fetches transfers from the callback and sends them,
+   paced by TCP backpressure from the server. */
+
+/* address: "host[:port][,4bit]", 4bit packs samples to halve the rate */
+int remote_open(const char *address, RemoteDevice **remote);
+int remote_close(RemoteDevice *remote);
+const char *remote_info(RemoteDevice *remote);
+
+int remote_set(RemoteDevice *remote, enum DeviceParam param, double value);
+
+int remote_start(RemoteDevice *remote, bool tx, hackrf_sample_block_cb_fn callback, void *ctx);
+int remote_stop(RemoteDevice *remote);
+int remote_is_streaming(RemoteDevice *remote);
+unsigned long remote_lost(RemoteDevice *remote);
+
+#endif /* HACKRF_REMOTE_H */
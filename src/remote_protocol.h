@@ -0,0 +1,206 @@
+/*
+* Copyright 2015 Communications Engineering Lab, KIT
+*
+* This is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3, or (at your option)
+* any later version.
+*
+* This software is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this software; see the file COPYING. If not, write to
+* the Free Software Foundation, Inc., 51 Franklin Street,
+* Boston, MA 02110-1301, USA.
+*/
+
+/* Wire format between hackrf_tcp_server and its clients. Every message
+   is a fixed size header, optionally followed by a payload:
+
+       magic   u32   REMOTE_MAGIC
+       type    u16   enum RemoteMessageType
+       flags   u16   REMOTE_FLAG_*, or the DeviceParam of REMOTE_SET
+       status  i32   libhackrf return code (replies)
+       length  u32   payload bytes
+       value   u64   parameter (as double bits), or sample index (data)
+
+   all little endian. The client sends one request at a time and waits
+   for the REMOTE_REPLY. Data messages are not acknowledged: RX data is
+   sent as the device delivers it, several transfers per write. Transfers
+   the server has to drop show up as a gap in the sample index. TX data
+   is only read as fast as the device consumes it, so TCP backpressure
+   paces the client. */
+
+#ifndef HACKRF_REMOTE_PROTOCOL_H
+#define HACKRF_REMOTE_PROTOCOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET remote_socket;
+#define REMOTE_INVALID_SOCKET INVALID_SOCKET
+#define remote_close_socket closesocket
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int remote_socket;
+#define REMOTE_INVALID_SOCKET (-1)
+#define remote_close_socket close
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define REMOTE_SEND_FLAGS MSG_NOSIGNAL  /* no SIGPIPE if the peer is gone */
+#else
+#define REMOTE_SEND_FLAGS 0
+#endif
+
+
+/* ======================================================================== */
+
+
+#define REMOTE_MAGIC         0x54465248  /* "HRFT" */
+#define REMOTE_VERSION       1
+#define REMOTE_DEFAULT_PORT  "28650"
+#define REMOTE_HEADER_SIZE   24
+#define REMOTE_MAX_PAYLOAD   (1 << 20)
+
+enum RemoteMessageType {
+    REMOTE_HELLO = 1,       /* value: protocol version, reply: device info */
+    REMOTE_SET,             /* flags: DeviceParam */
+    REMOTE_START_RX,        /* flags: REMOTE_FLAG_PACKED */
+    REMOTE_START_TX,        /* flags: REMOTE_FLAG_PACKED */
+    REMOTE_STOP,
+    REMOTE_REPLY,           /* server: status of the last request */
+    REMOTE_RX_DATA,         /* server: value is the index of the first sample */
+    REMOTE_TX_DATA,         /* client */
+    REMOTE_STREAM_END       /* server: device stopped streaming, status */
+};
+
+#define REMOTE_FLAG_PACKED 0x1  /* 4 bit I and Q in one byte per sample */
+
+typedef struct {
+    uint16_t type, flags;
+    int32_t status;
+    uint32_t length;
+    uint64_t value;
+} RemoteHeader;
+
+
+static inline void remote_put(uint8_t *buf, uint64_t value, int bytes)
+{
+    int i = 0; for (; i < bytes; i++) buf[i] = (uint8_t) (value >> (8 * i));
+}
+
+static inline uint64_t remote_get(const uint8_t *buf, int bytes)
+{
+    uint64_t value = 0;
+    int i = 0; for (; i < bytes; i++) value |= (uint64_t) buf[i] << (8 * i);
+    return value;
+}
+
+static inline void remote_header_pack(const RemoteHeader *header, uint8_t *buf)
+{
+    remote_put(buf, REMOTE_MAGIC, 4);
+    remote_put(buf + 4, header->type, 2);
+    remote_put(buf + 6, header->flags, 2);
+    remote_put(buf + 8, (uint32_t) header->status, 4);
+    remote_put(buf + 12, header->length, 4);
+    remote_put(buf + 16, header->value, 8);
+}
+
+static inline bool remote_header_unpack(const uint8_t *buf, RemoteHeader *header)
+{
+    header->type = (uint16_t) remote_get(buf + 4, 2);
+    header->flags = (uint16_t) remote_get(buf + 6, 2);
+    header->status = (int32_t) (uint32_t) remote_get(buf + 8, 4);
+    header->length = (uint32_t) remote_get(buf + 12, 4);
+    header->value = remote_get(buf + 16, 8);
+    return remote_get(buf, 4) == REMOTE_MAGIC && header->length <= REMOTE_MAX_PAYLOAD;
+}
+
+static inline uint64_t remote_from_double(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline double remote_to_double(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+/* ======================================================================== */
+
+
+/* keep the upper 4 bits of I and Q, in place, returns the packed length */
+static inline size_t remote_pack4(uint8_t *data, size_t length)
+{
+    size_t i = 0; for (; i < length / 2; i++)
+        data[i] = (uint8_t) ((data[2 * i] >> 4) | (data[2 * i + 1] & 0xf0));
+    return length / 2;
+}
+
+/* restore 8 bit samples at the center of each 4 bit step */
+static inline void remote_unpack4(const uint8_t *in, size_t length, uint8_t *out)
+{
+    size_t i = 0; for (; i < length; i++) {
+        out[2 * i] = (uint8_t) ((in[i] << 4) | 0x08);
+        out[2 * i + 1] = (uint8_t) ((in[i] & 0xf0) | 0x08);
+    }
+}
+
+
+/* ======================================================================== */
+
+
+static inline bool remote_send_all(remote_socket sock, const void *data, size_t length)
+{
+    const char *p = data;
+    while (length > 0) {
+        int sent = (int) send(sock, p, (int) length, REMOTE_SEND_FLAGS);
+        if (sent <= 0) return false;
+        p += sent;
+        length -= (size_t) sent;
+    }
+    return true;
+}
+
+static inline bool remote_recv_all(remote_socket sock, void *data, size_t length)
+{
+    char *p = data;
+    while (length > 0) {
+        int received = (int) recv(sock, p, (int) length, 0);
+        if (received <= 0) return false;
+        p += received;
+        length -= (size_t) received;
+    }
+    return true;
+}
+
+/* discard a payload that is not needed */
+static inline bool remote_skip(remote_socket sock, size_t length)
+{
+    char scratch[4096];
+    while (length > 0) {
+        size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+        if (!remote_recv_all(sock, scratch, chunk)) return false;
+        length -= chunk;
+    }
+    return true;
+}
+
+#endif /* HACKRF_REMOTE_PROTOCOL_H */